@@ -0,0 +1,100 @@
+#pragma once
+#include <limits>
+#include "Point.h"
+#include "Ray.h"
+
+// Axis-aligned bounding box
+class Aabb
+{
+public:
+	Point min, max;
+
+	// empty box, growing it by anything yields that thing's bounds
+	Aabb() : min(Point(std::numeric_limits<double>::max())), max(Point(-std::numeric_limits<double>::max()))
+	{
+	}
+
+	Aabb(const Point& a, const Point& b) : min(glm::min(a, b)), max(glm::max(a, b))
+	{
+	}
+
+	void grow(const Point& pt)
+	{
+		min = glm::min(min, pt);
+		max = glm::max(max, pt);
+	}
+
+	void grow(const Aabb& box)
+	{
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	// widen flat sides so rays grazing a planar primitive still register a hit on its box
+	void pad(double delta)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (max[axis] - min[axis] < delta)
+			{
+				min[axis] -= delta / 2;
+				max[axis] += delta / 2;
+			}
+		}
+	}
+
+	bool empty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	Point centroid() const
+	{
+		return 0.5 * (min + max);
+	}
+
+	Vec extent() const
+	{
+		return max - min;
+	}
+
+	double surfaceArea() const
+	{
+		if (empty())
+			return 0;
+
+		Vec e = extent();
+		return 2 * (e.x * e.y + e.y * e.z + e.z * e.x);
+	}
+
+	int longestAxis() const
+	{
+		Vec e = extent();
+
+		if (e.x > e.y && e.x > e.z)
+			return 0;
+		return e.y > e.z ? 1 : 2;
+	}
+
+	/// <summary>
+	/// Slab test. invDir is 1 / ray.dir(), computed once per ray by the caller.
+	/// </summary>
+	bool hit(const Ray& ray, const Vec& invDir, double tMin, double tMax) const
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double t0 = (min[axis] - ray.origin()[axis]) * invDir[axis];
+			double t1 = (max[axis] - ray.origin()[axis]) * invDir[axis];
+
+			if (invDir[axis] < 0)
+				std::swap(t0, t1);
+
+			tMin = t0 > tMin ? t0 : tMin;
+			tMax = t1 < tMax ? t1 : tMax;
+
+			if (tMax < tMin)
+				return false;
+		}
+		return true;
+	}
+};
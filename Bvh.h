@@ -0,0 +1,438 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "HittableList.h"
+#include "LinearBvh.h"
+#include "WideBvh.h"
+
+enum class BvhLayout
+{
+	Binary,
+	Wide4,
+	Wide8
+};
+
+// the widest layout this CPU has SIMD box tests for, binary where it has none
+inline BvhLayout defaultBvhLayout()
+{
+	switch (detectSimd())
+	{
+	case SimdLevel::Avx2: return BvhLayout::Wide8;
+	case SimdLevel::Sse: return BvhLayout::Wide4;
+	default: return BvhLayout::Binary;
+	}
+}
+
+/// <summary>
+/// Acceleration structure over the objects of a HittableList. Drop-in replacement for the list in
+/// Camera::render: closest hits are the same, ties included (the object earlier in the list
+/// wins), but found in roughly O(log N) box tests per ray. The binary tree is always built;
+/// rays can instead go through a 4 or 8 wide tree collapsed from it (setLayout).
+/// Light sampling (pdf / randomSample) is forwarded to the list.
+/// </summary>
+class Bvh : public Hittable
+{
+public:
+	enum class UpdateAction
+	{
+		Refit,
+		PartialRebuild,
+		FullRebuild
+	};
+
+	struct UpdateStats
+	{
+		UpdateAction action = UpdateAction::Refit;
+		double costGrowth = 1; // tree quality afterwards relative to right after the last full build
+		int rebuiltPrimitives = 0;
+		double milliseconds = 0;
+	};
+
+	explicit Bvh(const HittableList& list) : list(list)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		build();
+		setLayout(defaultBvhLayout());
+
+		auto stop = std::chrono::high_resolution_clock::now();
+		buildTime = std::chrono::duration<double, std::milli>(stop - start).count();
+	}
+
+	/// <summary>
+	/// Uses a hierarchy built earlier (see SceneCache) over the objects of list instead of building
+	/// one; its primitiveOrder() says which object each leaf position holds.
+	/// </summary>
+	Bvh(const HittableList& list, LinearBvh prebuilt) : list(list), bvh(std::move(prebuilt))
+	{
+		for (int index : bvh.primitiveOrder())
+			primitives.push_back(list.objects()[index].get());
+
+		setLayout(defaultBvhLayout());
+	}
+
+	bool hit(const Ray& ray, const Interval& interval, Hit& hit) const override
+	{
+		double closestHit = interval.max;
+		long long visits = 0;
+		int hitIndex = -1;
+		const std::vector<int>& order = bvh.primitiveOrder();
+
+		auto intersect = [&](int prim, double tMin, double& closest)
+		{
+			Hit thisHit;
+
+			// let hits at exactly closest through too, to settle ties by list position
+			if (!primitives[prim]->hit(ray, Interval(tMin, std::nextafter(closest, std::numeric_limits<double>::infinity())), thisHit))
+				return false;
+
+			int index = order[prim];
+			if (thisHit.t == closest && (hitIndex < 0 || index > hitIndex))
+				return false;
+
+			closest = thisHit.t;
+			hitIndex = index;
+			hit = thisHit;
+			return true;
+		};
+
+		bool hitValid;
+		switch (layout)
+		{
+		case BvhLayout::Wide8:
+			hitValid = wide8.traverse(ray, interval.min, closestHit, intersect, visits);
+			break;
+		case BvhLayout::Wide4:
+			hitValid = wide4.traverse(ray, interval.min, closestHit, intersect, visits);
+			break;
+		default:
+			hitValid = bvh.traverse(ray, interval.min, closestHit, intersect, visits);
+			break;
+		}
+
+		countVisits(visits);
+		return hitValid;
+	}
+
+	bool occluded(const Ray& ray, const Interval& interval) const override
+	{
+		long long visits = 0;
+
+		auto occludedPrim = [&](int prim)
+		{
+			return primitives[prim]->occluded(ray, interval);
+		};
+
+		bool blocked;
+		switch (layout)
+		{
+		case BvhLayout::Wide8:
+			blocked = wide8.traverseAny(ray, interval.min, interval.max, occludedPrim, visits);
+			break;
+		case BvhLayout::Wide4:
+			blocked = wide4.traverseAny(ray, interval.min, interval.max, occludedPrim, visits);
+			break;
+		default:
+			blocked = bvh.traverseAny(ray, interval.min, interval.max, occludedPrim, visits);
+			break;
+		}
+
+		countVisits(visits);
+		return blocked;
+	}
+
+	Aabb boundingBox() const override
+	{
+		return bvh.bounds();
+	}
+
+	double pdf(const Point& origin, const Point& dir) const override
+	{
+		return list.pdf(origin, dir);
+	}
+
+	Vec randomSample(Sampler& sampler, const Point& origin) const override
+	{
+		return list.randomSample(sampler, origin);
+	}
+
+	double power(const MaterialTable& materials) const override
+	{
+		return list.power(materials);
+	}
+
+	LightBounds lightBounds(const MaterialTable& materials) const override
+	{
+		return list.lightBounds(materials);
+	}
+
+	/// <summary>
+	/// Brings the hierarchy up to date after objects of the list moved, i.e. their boundingBox()
+	/// changed. Refitting keeps the tree valid but not good: boxes of moved objects stretch their
+	/// ancestors. Quality is the SAH cost over the summed areas of the objects' own boxes, which a
+	/// good tree keeps roughly constant however far apart the objects are. Once it has grown past
+	/// maxGrowth times what the last full build achieved, the subtrees whose cost grew that much
+	/// (and hold at most a quarter of the objects each) are rebuilt, and if they would cover most
+	/// of the scene or rebuilding them does not bring the quality back, the whole tree is.
+	/// Not thread-safe with rendering; call it between frames.
+	/// </summary>
+	UpdateStats update(double maxGrowth = 1.25)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		UpdateStats stats;
+		std::vector<Aabb> leafBounds = primitiveBounds();
+
+		if (baseline.empty())
+		{
+			// the nodes still have the bounds they were built with
+			baseline = bvh.subtreeCosts();
+			builtQuality = quality(baseline, leafBounds);
+		}
+
+		bvh.refit(leafBounds);
+		stats.costGrowth = costGrowth(leafBounds);
+
+		if (stats.costGrowth > maxGrowth)
+		{
+			auto degraded = degradedSubtrees(maxGrowth);
+
+			int count = 0;
+			for (auto& subtree : degraded)
+				count += subtree.count;
+
+			if (count <= (int)primitives.size() / 2)
+			{
+				rebuildSubtrees(degraded, leafBounds);
+				stats.action = UpdateAction::PartialRebuild;
+				stats.rebuiltPrimitives = count;
+				stats.costGrowth = costGrowth(leafBounds);
+			}
+		}
+
+		if (stats.costGrowth > maxGrowth)
+		{
+			build();
+			stats.action = UpdateAction::FullRebuild;
+			stats.rebuiltPrimitives = (int)primitives.size();
+			stats.costGrowth = 1;
+		}
+
+		// the wide tree copies the binary bounds, so collapse it again
+		setLayout(layout);
+
+		auto stop = std::chrono::high_resolution_clock::now();
+		stats.milliseconds = std::chrono::duration<double, std::milli>(stop - start).count();
+		return stats;
+	}
+
+	/// <summary>
+	/// Picks the tree rays go through, collapsing the binary one into a wide one if needed. The
+	/// wide trees use the widest SIMD box test the CPU runs and scalar code otherwise.
+	/// Not thread-safe with rendering.
+	/// </summary>
+	void setLayout(BvhLayout newLayout)
+	{
+		layout = newLayout;
+		wide4 = layout == BvhLayout::Wide4 ? WideBvh<4>(bvh) : WideBvh<4>();
+		wide8 = layout == BvhLayout::Wide8 ? WideBvh<8>(bvh) : WideBvh<8>();
+	}
+
+	BvhLayout currentLayout() const { return layout; }
+
+	// instruction set the box tests of the current layout use
+	SimdLevel simdLevel() const
+	{
+		switch (layout)
+		{
+		case BvhLayout::Wide8: return wide8.simdLevel();
+		case BvhLayout::Wide4: return wide4.simdLevel();
+		default: return SimdLevel::Scalar;
+		}
+	}
+
+	double buildMilliseconds() const { return buildTime; }
+	int nodeCount() const { return bvh.nodeCount(); }
+	int wideNodeCount() const { return layout == BvhLayout::Wide8 ? wide8.nodeCount() : wide4.nodeCount(); }
+
+	const LinearBvh& linear() const { return bvh; }
+	// the objects in leaf order, as leaf ranges index them
+	const std::vector<const Hittable*>& orderedPrimitives() const { return primitives; }
+
+	// average number of nodes whose box was tested per hit() / occluded() call since the last reset
+	double averageNodeVisits() const
+	{
+		long long rays = 0;
+		long long visits = 0;
+		for (auto& slot : stats)
+		{
+			rays += slot.rays.load(std::memory_order_relaxed);
+			visits += slot.visits.load(std::memory_order_relaxed);
+		}
+		return rays > 0 ? (double)visits / rays : 0.0;
+	}
+
+	void resetStats()
+	{
+		for (auto& slot : stats)
+		{
+			slot.rays = 0;
+			slot.visits = 0;
+		}
+	}
+
+private:
+	HittableList list;
+	LinearBvh bvh;
+	std::vector<const Hittable*> primitives;
+	double buildTime = 0;
+
+	BvhLayout layout = BvhLayout::Binary;
+	WideBvh<4> wide4; // built from bvh for the wide layouts
+	WideBvh<8> wide8;
+
+	// subtree costs and tree quality as last (re)built, what update() measures degradation
+	// against; filled on the first update
+	std::vector<double> baseline;
+	double builtQuality = 0;
+
+	struct Subtree
+	{
+		int node, depth, count;
+	};
+
+	void build()
+	{
+		auto& objects = list.objects();
+		std::vector<Aabb> bounds;
+		bounds.reserve(objects.size());
+
+		for (auto& object : objects)
+			bounds.push_back(object->boundingBox());
+
+		bvh = LinearBvh(bounds);
+
+		// leaves index primitives directly, so store them in leaf order
+		primitives.clear();
+		primitives.reserve(objects.size());
+		for (int index : bvh.primitiveOrder())
+			primitives.push_back(objects[index].get());
+
+		baseline.clear();
+	}
+
+	std::vector<Aabb> primitiveBounds() const
+	{
+		std::vector<Aabb> bounds;
+		bounds.reserve(primitives.size());
+
+		for (auto* primitive : primitives)
+			bounds.push_back(primitive->boundingBox());
+
+		return bounds;
+	}
+
+	static double quality(const std::vector<double>& costs, const std::vector<Aabb>& leafBounds)
+	{
+		double area = 0;
+		for (auto& box : leafBounds)
+			area += box.surfaceArea();
+
+		return area > 0 && !costs.empty() ? costs[0] / area : 0;
+	}
+
+	double costGrowth(const std::vector<Aabb>& leafBounds) const
+	{
+		return builtQuality > 0 ? quality(bvh.subtreeCosts(), leafBounds) / builtQuality : 1;
+	}
+
+	// the largest subtrees whose cost grew past maxGrowth, top down so each is taken whole
+	std::vector<Subtree> degradedSubtrees(double maxGrowth) const
+	{
+		std::vector<double> costs = bvh.subtreeCosts();
+		const BvhNode* nodes = bvh.nodeData();
+		int maxPrims = std::max(1, (int)primitives.size() / 4);
+
+		std::vector<Subtree> degraded;
+		std::vector<std::pair<int, int>> stack{ { 0, 0 } }; // node, depth
+
+		while (!stack.empty())
+		{
+			auto [index, depth] = stack.back();
+			stack.pop_back();
+
+			int first, count;
+			bvh.subtreePrimitives(index, first, count);
+
+			if (count <= maxPrims && costs[index] > maxGrowth * baseline[index])
+			{
+				degraded.push_back({ index, depth, count });
+			}
+			else if (nodes[index].primCount == 0)
+			{
+				stack.push_back({ (int)nodes[index].offset, depth + 1 });
+				stack.push_back({ index + 1, depth + 1 });
+			}
+		}
+		return degraded;
+	}
+
+	void rebuildSubtrees(std::vector<Subtree> subtrees, const std::vector<Aabb>& leafBounds)
+	{
+		// from the back, so splicing one subtree leaves the indices of the others alone
+		std::sort(subtrees.begin(), subtrees.end(), [](const Subtree& a, const Subtree& b) { return a.node > b.node; });
+
+		const double fresh = -1;
+
+		for (auto& subtree : subtrees)
+		{
+			int first, count;
+			bvh.subtreePrimitives(subtree.node, first, count);
+			int end = bvh.subtreeEnd(subtree.node);
+
+			std::vector<int> order = bvh.rebuildSubtree(subtree.node, subtree.depth, leafBounds);
+
+			std::vector<const Hittable*> old(primitives.begin() + first, primitives.begin() + first + count);
+			for (int i = 0; i < count; i++)
+				primitives[first + i] = old[order[i]];
+
+			// new nodes get their own costs as baseline once everything is spliced
+			int newEnd = bvh.subtreeEnd(subtree.node);
+			baseline.erase(baseline.begin() + subtree.node, baseline.begin() + end);
+			baseline.insert(baseline.begin() + subtree.node, newEnd - subtree.node, fresh);
+		}
+
+		std::vector<double> costs = bvh.subtreeCosts();
+		for (int i = 0; i < (int)baseline.size(); i++)
+		{
+			if (baseline[i] == fresh)
+				baseline[i] = costs[i];
+		}
+	}
+
+	// Visit statistics, striped over cache-line sized slots picked per thread: render threads each
+	// add into their own line instead of all contending for one on every ray.
+	struct alignas(64) StatSlot
+	{
+		std::atomic<long long> rays{ 0 };
+		std::atomic<long long> visits{ 0 };
+	};
+
+	static constexpr int StatSlots = 64;
+	mutable std::array<StatSlot, StatSlots> stats;
+
+	void countVisits(long long visits) const
+	{
+		static std::atomic<int> nextSlot{ 0 };
+		thread_local int slot = nextSlot.fetch_add(1, std::memory_order_relaxed) % StatSlots;
+
+		stats[slot].rays.fetch_add(1, std::memory_order_relaxed);
+		stats[slot].visits.fetch_add(visits, std::memory_order_relaxed);
+	}
+};
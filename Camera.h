@@ -2,13 +2,26 @@
 #include <iostream>
 #include <stdexcept>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
 
 #include "Color.h"
+#include "Film.h"
+#include "Checkpoint.h"
+#include "WorkerProcesses.h"
 #include "HittableList.h"
 #include "Random.h"
+#include "Sampler.h"
 #include "RayTracing.h"
 #include "Pdf.h"
 #include "Material.h"
+#include "ThreadPool.h"
+#include "LightSampler.h"
 
 struct CamParams
 {
@@ -24,7 +37,18 @@ public:
 	Point lookAt = Point(0.0, 0.0, -1.0);
 	Vec upDir = Vec(0.0, 1.0, 0.0);
 	Color background = Color(0, 0, 0);
-	double mixturePDFRatio = 0.5;
+	int threadCount = 0; // 0 = one render thread per hardware thread
+	int tileSize = 16; // edge length in pixels of the square tiles handed to render threads
+	int rouletteDepth = 3; // bounces before Russian roulette may end a path, < 0 disables it
+	double rouletteMinSurvival = 0.05; // clamp on the survival probability, bounds the reweighting of survivors
+	double rouletteMaxSurvival = 1.0;
+	SamplerType sampler = SamplerType::Sobol; // where the uniform numbers for each pixel sample come from
+	double adaptiveTargetError = 0; // relative error at which a pixel stops sampling, 0 = samplesPerPixel everywhere
+	int adaptiveMinSpp = 16; // samples every pixel gets before its error is trusted
+	int adaptiveMaxSpp = 1024;
+	int progressivePassSpp = 0; // samples per pixel added per pass, 0 renders everything in one pass
+	std::string checkpointPath; // if set, saved after every pass and resumed from when it already exists
+	int processCount = 1; // > 1 splits every pixel's samples over that many forked worker processes
 };
 
 class Camera
@@ -34,7 +58,8 @@ public:
 	{
 		this->samplesPerPixel = params.samplesPerPixel;
 		this->maxDepth = params.maxDepth;
-		this->rand = random;
+		// drawn once, so every render and sample slice of this camera follows the same sequences
+		this->samplerSeed = random.randomUint32();
 		this->focusDist = params.focalDist;
 		this->defocusAngle = params.defocusAngle;
 		this->background = params.background;
@@ -86,51 +111,146 @@ public:
 		this->pixel00Pos = viewportTopLeft + 0.5 * deltaU + 0.5 * deltaV;
 
 		img.resize(imgHeight * imgWidth *  3);
+		hdr.resize(imgHeight * imgWidth * 3);
 
-		this->mixturePDFRatio = params.mixturePDFRatio;
+		this->rouletteDepth = params.rouletteDepth;
+		this->rouletteMinSurvival = params.rouletteMinSurvival;
+		this->rouletteMaxSurvival = params.rouletteMaxSurvival;
+
+		if (rouletteMinSurvival <= 0.0 || rouletteMinSurvival > rouletteMaxSurvival || rouletteMaxSurvival > 1.0)
+		{
+			throw std::invalid_argument("Russian roulette survival clamp must satisfy 0 < min <= max <= 1");
+		}
+
+		this->threadCount = params.threadCount;
+		this->tileSize = params.tileSize;
+		this->samplerType = params.sampler;
+
+		if (tileSize < 1)
+		{
+			throw std::invalid_argument("Tile size < 1");
+		}
+
+		this->adaptiveTargetError = params.adaptiveTargetError;
+		this->adaptiveMinSpp = params.adaptiveMinSpp;
+		this->adaptiveMaxSpp = params.adaptiveMaxSpp;
+		this->progressivePassSpp = params.progressivePassSpp;
+		this->checkpointPath = params.checkpointPath;
+		this->processCount = params.processCount;
+
+		if (processCount > 1 && (adaptive() || !checkpointPath.empty()))
+		{
+			throw std::invalid_argument("Worker processes can't be combined with adaptive sampling or checkpoints");
+		}
+
+		if (adaptiveTargetError > 0 && (adaptiveMinSpp < 2 || adaptiveMinSpp > adaptiveMaxSpp))
+		{
+			throw std::invalid_argument("Adaptive sampling needs 2 <= min spp <= max spp");
+		}
 	}
 
-	Color rayColor(const Ray& ray, const HittableList& hittables, const Hittable& lights, int depth)
+	/// <summary>
+	/// Path traces one camera ray for up to depth bounces. Instead of recursing per bounce, the loop
+	/// carries the path throughput and adds throughput-weighted emission as it goes.
+	/// Light is gathered two ways at every non-specular vertex: next-event estimation sends a shadow
+	/// ray to a point sampled on the lights, and the scattered ray (sampled from the material's pdf)
+	/// picks up emission when it lands on a light. Both are weighted with the power heuristic, so each
+	/// dominates where it has the lower variance.
+	/// After rouletteDepth bounces, Russian roulette ends paths whose throughput has dropped off:
+	/// a path survives with probability equal to its largest throughput channel (clamped), and
+	/// survivors are divided by that probability so the estimate stays unbiased.
+	/// </summary>
+	Color rayColor(const Ray& ray, const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials, int depth, Sampler& sampler) const
 	{
-		if (depth <= 0)
-			return Color(0, 0, 0);
-
 		Interval interval(0.0001, 100);
-		Hit hit;
+		Color radiance(0, 0, 0);
+		Color throughput(1, 1, 1);
+		Ray current = ray;
+
+		// state of the previous vertex, for weighting emission found by the scattered ray
+		bool prevSpecular = true; // the camera ray counts as specular, nothing else could have sampled it
+		double prevScatterPdf = 0;
+		Point prevPos;
 
-		if (hittables.hit(ray, interval, hit))
+		for (int bounce = 0; bounce < depth; bounce++)
 		{
-			Color emitted = hit.mat->emitted(ray, hit, rand);
+			if (rouletteDepth >= 0 && bounce >= rouletteDepth)
+			{
+				double survival = std::clamp(std::max({ throughput.x, throughput.y, throughput.z }),
+					rouletteMinSurvival, rouletteMaxSurvival);
+
+				if (sampler.get1D() >= survival)
+					break;
 
-			const ScatterRecord scatterRecord = hit.mat->scatter(ray, hit, rand);
+				throughput /= survival;
+			}
+
+			Hit hit;
+
+			if (!hittables.hit(current, interval, hit))
+			{
+				radiance += throughput * background;
+				break;
+			}
+
+			const Material& mat = materials[hit.mat];
+			Color emitted = mat.emitted(current, hit, sampler);
+
+			if (emitted != Color(0, 0, 0))
+			{
+				double weight = 1.0;
+
+				// next-event estimation at the previous vertex could also have produced this path,
+				// but only if what we hit is one of the lights it samples
+				if (!prevSpecular)
+				{
+					double lightPmf = lights.pmf(prevPos, hit.object);
+
+					if (lightPmf > 0)
+						weight = powerHeuristic(prevScatterPdf, lightPmf * hit.object->pdf(prevPos, current.dir()));
+				}
+
+				radiance += throughput * emitted * weight;
+			}
+
+			// nothing found past here could be counted anyway
+			if (bounce + 1 >= depth)
+				break;
+
+			const ScatterRecord scatterRecord = mat.scatter(current, hit, sampler);
 
 			if (!scatterRecord.scattered)
-				return emitted;
+				break;
 
 			if (scatterRecord.skipPdf)
 			{
 				// rendering equation is kind of in here
-				return emitted + (rayColor(scatterRecord.skipPdfRay, hittables, lights, depth - 1))
-					* scatterRecord.attenuation;
-			} 
-
-			// generate scattered ray based on importance sampling
-			const MixturePdf surfacePdf(std::make_shared<HittablePdf>(lights, hit.pos), scatterRecord.pdfPtr, mixturePDFRatio);
-			Ray out(hit.pos, surfacePdf.generate(rand));
-			double samplingPDF = surfacePdf.value(out.dir());
-			double scatteringPDF = scatterRecord.pdfPtr->value(out.dir());
-			assert(samplingPDF != 0);
+				throughput *= scatterRecord.attenuation;
+				current = scatterRecord.skipPdfRay;
+				prevSpecular = true;
+				continue;
+			}
+
+			radiance += throughput * sampleLight(hit, scatterRecord, hittables, lights, materials, interval, sampler);
+
+			// scattered direction is drawn from the scattering pdf itself, so scatteringPDF / samplingPDF cancels
+			Ray out(hit.pos, scatterRecord.pdf.generate(sampler));
+			double scatteringPDF = scatterRecord.pdf.value(out.dir());
 			assert(scatteringPDF != 0);
 
 			// rendering equation is kind of in here
-			return emitted + (rayColor(out, hittables, lights, depth - 1)) * scatterRecord.attenuation * scatteringPDF / samplingPDF;
-		}
-		else {
-			return background;
+			throughput *= scatterRecord.attenuation;
+			current = out;
+
+			prevSpecular = false;
+			prevScatterPdf = scatteringPDF;
+			prevPos = hit.pos;
 		}
 
+		return radiance;
 	}
-	Color aces_approx(const Color& v)
+
+	Color aces_approx(const Color& v) const
 		{
 			Color val = v * 0.6;
 			double a = 2.51f;
@@ -141,63 +261,339 @@ public:
 			return glm::clamp((val * (a * val + b)) / (val * (c * val + d) + e), 0.0, 1.0);
 		}
 
-	double linearToGamma(double linear)
+	double linearToGamma(double linear) const
 	{
 		return linear > 0.0 ? pow(linear, 1.0 / 2.2) : 0.0;
 	}
 
-	const std::vector<unsigned char> render(const HittableList& hittables, const Hittable& lights)
+	const std::vector<unsigned char> render(const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials)
 	{
 		auto start = std::chrono::high_resolution_clock::now();
-		for (int row = 0; row < imgHeight; row++)
-		{
-			std::cout << "Scanlines remaining: " << (imgHeight - row) << ' ' << std::endl;
 
-			for (int col = 0; col < imgWidth; col++)
+		// Every pixel sample addresses its own numbers by (pixel, sample index, dimension), so workers
+		// never share random state and the image does not depend on the tiling or on which worker rendered what.
+		CheckpointHeader header = startHeader();
+		Film film(imgWidth, imgHeight);
+
+		if (processCount > 1)
+		{
+			film = renderInProcesses(hittables, lights, materials, header);
+		}
+		else
+		{
+			if (!checkpointPath.empty() && Checkpoint::load(checkpointPath, header, film))
 			{
-				Color color(0, 0, 0);
-				for (int s = 0; s < samplesPerPixel; s++)
-				{
-					auto ray = sampleRayToPixel(row, col);
-					color += rayColor(ray, hittables, lights, maxDepth);
-				}
-				color /= samplesPerPixel;
-				color = aces_approx(color);
-				img[3 * (row * imgWidth + col)] = linearToGamma(color.x) * 255;
-				img[3 * (row * imgWidth + col) + 1] = linearToGamma(color.y) * 255;
-				img[3 * (row * imgWidth + col) + 2] = linearToGamma(color.z) * 255;
+				// carry on with the checkpoint's seed and sampler so resumed pixels continue their sequences
+				if (header.samplerType != (uint32_t)samplerType)
+					throw std::runtime_error("Checkpoint " + checkpointPath + " was rendered with a different sampler");
+
+				std::cout << "Resuming from " << checkpointPath << " at "
+					<< (double)film.totalSamples() / (imgWidth * imgHeight) << " samples per pixel" << std::endl;
 			}
+
+			// the checkpoint's header only fixes the sampler, this run's settings decide how far to go
+			accumulate(hittables, lights, materials, header, film, 0, targetSpp(), threadCount, true);
+		}
+
+		for (int pixel = 0; pixel < imgWidth * imgHeight; pixel++)
+		{
+			Color color = film.mean(pixel);
+			hdr[3 * pixel] = (float)color.x;
+			hdr[3 * pixel + 1] = (float)color.y;
+			hdr[3 * pixel + 2] = (float)color.z;
 		}
 
+		img = toneMap(hdr);
+
 		auto stop = std::chrono::high_resolution_clock::now();
 		auto duration = duration_cast<std::chrono::seconds>(stop - start);
 		std::cout << duration.count() << std::endl;
+		std::cout << "Average samples per pixel: " << (double)film.totalSamples() / (imgWidth * imgHeight) << std::endl;
 
 		return img;
 	}
 
+	/// <summary>
+	/// Renders only sample indices [sampleBegin, sampleEnd) of every pixel into a film of its own.
+	/// Cameras built from the same CamParams and Random seed draw the same sequences, so slices
+	/// rendered anywhere (other processes, other machines) add up, through Film::merge, to exactly
+	/// the samples a single render would have taken. Throws for adaptive sampling, whose stopping
+	/// decisions need all of a pixel's samples in one place, and when a checkpoint path is set, since
+	/// a slice is not a resumable render.
+	/// </summary>
+	Film renderSamples(const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials,
+		int sampleBegin, int sampleEnd)
+	{
+		if (adaptive() || !checkpointPath.empty())
+		{
+			throw std::invalid_argument("Sample slices can't be combined with adaptive sampling or checkpoints");
+		}
+
+		CheckpointHeader header = startHeader();
+		Film film(imgWidth, imgHeight);
+		accumulate(hittables, lights, materials, header, film, sampleBegin, sampleEnd - sampleBegin, threadCount, false);
+		return film;
+	}
+
+	/// <summary>
+	/// 8-bit display image from a linear RGB buffer of this camera's size: exposure scale, ACES fit,
+	/// gamma. Rows are independent and spread over the render threads, so re-exposing the
+	/// linearImage of a finished render is cheap.
+	/// </summary>
+	std::vector<unsigned char> toneMap(const std::vector<float>& linear, double exposure = 1.0) const
+	{
+		std::vector<unsigned char> out(linear.size());
+		ThreadPool pool(threadCount);
+
+		pool.parallelFor(imgHeight, [&](int row, int worker)
+		{
+			for (int i = 3 * row * imgWidth; i < 3 * (row + 1) * imgWidth; i += 3)
+			{
+				Color color = aces_approx(exposure * Color(linear[i], linear[i + 1], linear[i + 2]));
+				out[i] = linearToGamma(color.x) * 255;
+				out[i + 1] = linearToGamma(color.y) * 255;
+				out[i + 2] = linearToGamma(color.z) * 255;
+			}
+		});
+
+		return out;
+	}
+
+	// linear radiance of the last render, RGB32F, for the HDR writers in ImageIO.h
+	const std::vector<float>& linearImage() const { return hdr; }
+
 	int imageWidth() const { return imgWidth; }
 	int imageHeight() const { return imgHeight; }
 
-	Ray sampleRayToPixel(int row, int col)
+	Ray sampleRayToPixel(int row, int col, Sampler& sampler) const
 	{
-		auto pixelPos = pixel00Pos + (row + rand.randomDouble(-0.5, 0.5)) * deltaV +
-			(col + rand.randomDouble(-0.5, 0.5)) * deltaU;
+		Point2 jitter = sampler.get2D();
+		auto pixelPos = pixel00Pos + (row + jitter.x - 0.5) * deltaV +
+			(col + jitter.y - 0.5) * deltaU;
 
-		auto rayOrigin = (defocusAngle <= 0.0) ? cameraOrigin : defocusDiskSample();
+		auto rayOrigin = (defocusAngle <= 0.0) ? cameraOrigin : defocusDiskSample(sampler);
 		auto rayDir = pixelPos - rayOrigin;
 
 		return Ray(rayOrigin, rayDir);
 	}
 
-	Point defocusDiskSample()
+	Point defocusDiskSample(Sampler& sampler) const
 	{
-		auto randOnDisk = rand.sampleUnitDisk();
+		auto randOnDisk = sampler.sampleUnitDisk();
 		return cameraOrigin + randOnDisk.x * defocusU + randOnDisk.y * defocusV;
 	}
 
 private:
+	// weight for a sample drawn with pdf f when another strategy could have drawn it with pdf g
+	static double powerHeuristic(double f, double g)
+	{
+		double f2 = f * f;
+		double g2 = g * g;
+		return f2 + g2 > 0 ? f2 / (f2 + g2) : 0.0;
+	}
+
+	/// <summary>
+	/// Next-event estimation: direct light reaching hit along a direction sampled from the lights,
+	/// MIS-weighted against the material having sampled the same direction. Returned value still
+	/// needs the path throughput applied.
+	/// </summary>
+	Color sampleLight(const Hit& hit, const ScatterRecord& scatterRecord, const Hittable& hittables,
+		const LightSampler& lights, const MaterialTable& materials, const Interval& interval, Sampler& sampler) const
+	{
+		LightSample lightSample = lights.sample(hit.pos, sampler);
+
+		if (!lightSample.light)
+			return Color(0, 0, 0);
+
+		const Hittable& light = *lightSample.light;
+		Ray shadowRay(hit.pos, light.randomSample(sampler, hit.pos));
+
+		double lightPDF = lightSample.pmf * light.pdf(hit.pos, shadowRay.dir());
+		double scatteringPDF = scatterRecord.pdf.value(shadowRay.dir());
+
+		if (lightPDF <= 0 || scatteringPDF <= 0)
+			return Color(0, 0, 0);
+
+		Hit lightHit;
+		if (!light.hit(shadowRay, Interval(interval.min, std::numeric_limits<double>::max()), lightHit))
+			return Color(0, 0, 0);
+
+		Color emitted = materials[lightHit.mat].emitted(shadowRay, lightHit, sampler);
+		if (emitted == Color(0, 0, 0))
+			return Color(0, 0, 0);
+
+		// lights are part of the scene too, so stop short of the light itself
+		if (hittables.occluded(shadowRay, Interval(interval.min, lightHit.t - interval.min)))
+			return Color(0, 0, 0);
+
+		return scatterRecord.attenuation * emitted * (scatteringPDF * powerHeuristic(lightPDF, scatteringPDF) / lightPDF);
+	}
+
+	CheckpointHeader startHeader()
+	{
+		CheckpointHeader header;
+		header.width = imgWidth;
+		header.height = imgHeight;
+		header.samplerType = (uint32_t)samplerType;
+		header.samplerSpp = targetSpp();
+		header.seed = samplerSeed;
+		return header;
+	}
+
+	int targetSpp() const
+	{
+		return adaptive() ? adaptiveMaxSpp : samplesPerPixel;
+	}
+
+	/// <summary>
+	/// Takes every pixel of film up to sampleCount samples, numbered from sampleBegin, with the
+	/// sampler described by header. Progressive mode brings every pixel up to limit, checkpoints,
+	/// and raises limit by a pass; pixels a resumed checkpoint already took past limit sit the pass out.
+	/// </summary>
+	void accumulate(const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials,
+		const CheckpointHeader& header, Film& film, int sampleBegin, int sampleCount, int threads, bool log) const
+	{
+		int tilesX = (imgWidth + tileSize - 1) / tileSize;
+		int tilesY = (imgHeight + tileSize - 1) / tileSize;
+		int tileCount = tilesX * tilesY;
+		int passSpp = progressivePassSpp > 0 ? progressivePassSpp : sampleCount;
+
+		Sampler sampler(samplerType, header.samplerSpp, header.seed);
+
+		ThreadPool pool(threads);
+		std::mutex logMutex;
+
+		for (int limit = std::min(passSpp, sampleCount); ; limit = std::min(limit + passSpp, sampleCount))
+		{
+			std::atomic<int> tilesRemaining(tileCount);
+			std::atomic<long long> samplesAdded(0);
+
+			pool.parallelFor(tileCount, [&](int tile, int worker)
+			{
+				int rowStart = (tile / tilesX) * tileSize;
+				int colStart = (tile % tilesX) * tileSize;
+
+				samplesAdded += renderTile(hittables, lights, materials, rowStart, std::min(rowStart + tileSize, imgHeight),
+					colStart, std::min(colStart + tileSize, imgWidth), sampleBegin, limit, sampler, film);
+
+				int remaining = --tilesRemaining;
+				if (!log || passSpp < sampleCount)
+					return;
+
+				std::lock_guard<std::mutex> lock(logMutex);
+				std::cout << "Tiles remaining: " << remaining << ' ' << std::endl;
+			});
+
+			if (samplesAdded > 0)
+			{
+				if (!checkpointPath.empty())
+					Checkpoint::save(checkpointPath, header, film);
+
+				if (log && passSpp < sampleCount)
+					std::cout << "Pass done, up to " << limit << " samples per pixel" << std::endl;
+			}
+
+			if (limit >= sampleCount)
+				break;
+		}
+	}
+
+	/// <summary>
+	/// Splits the sample indices of every pixel evenly over processCount worker processes. Each
+	/// renders its slice with its share of the threads and sends back its film, and the films are
+	/// merged in worker order so the result does not depend on which worker finished first.
+	/// </summary>
+	Film renderInProcesses(const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials,
+		const CheckpointHeader& header) const
+	{
+		int totalSpp = (int)header.samplerSpp;
+		int hardwareThreads = threadCount > 0 ? threadCount : (int)std::max(1u, std::thread::hardware_concurrency());
+		int workerThreads = std::max(1, hardwareThreads / processCount);
+
+		std::cout << "Rendering in " << processCount << " worker processes" << std::endl;
+
+		auto partials = runWorkerProcesses(processCount, [&](int k)
+		{
+			int sampleBegin = (int)((long long)totalSpp * k / processCount);
+			int sampleEnd = (int)((long long)totalSpp * (k + 1) / processCount);
+
+			Film partial(imgWidth, imgHeight);
+			accumulate(hittables, lights, materials, header, partial, sampleBegin, sampleEnd - sampleBegin, workerThreads, false);
+
+			std::ostringstream out(std::ios::binary);
+			partial.write(out);
+			return out.str();
+		});
+
+		Film film(imgWidth, imgHeight);
+
+		for (auto& bytes : partials)
+		{
+			Film partial(imgWidth, imgHeight);
+			std::istringstream in(bytes, std::ios::binary);
+
+			if (!partial.read(in))
+				throw std::runtime_error("Worker process sent back a truncated film");
+
+			film.merge(partial);
+		}
+
+		return film;
+	}
+
+	bool adaptive() const
+	{
+		return adaptiveTargetError > 0;
+	}
+
+	Color samplePixel(const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials,
+		int row, int col, int sampleIndex, Sampler& sampler) const
+	{
+		sampler.startPixelSample(row * imgWidth + col, sampleIndex);
+		auto ray = sampleRayToPixel(row, col, sampler);
+		return rayColor(ray, hittables, lights, materials, maxDepth, sampler);
+	}
+
+	/// <summary>
+	/// Tiles never overlap, so workers accumulate their pixels straight into the shared film.
+	/// Brings every pixel of the tile up to limit samples, continuing from what the film already has;
+	/// the film's sample n is sample index sampleBegin + n of the pixel.
+	/// In adaptive mode a pixel takes batches of adaptiveMinSpp instead, and stops early once it has
+	/// at least adaptiveMinSpp samples and its relative error is below adaptiveTargetError.
+	/// Returns the number of samples taken.
+	/// </summary>
+	long long renderTile(const Hittable& hittables, const LightSampler& lights, const MaterialTable& materials,
+		int rowStart, int rowEnd, int colStart, int colEnd, int sampleBegin, int limit, Sampler sampler, Film& film) const
+	{
+		long long taken = 0;
+		int batch = adaptive() ? adaptiveMinSpp : limit;
+
+		for (int row = rowStart; row < rowEnd; row++)
+		{
+			for (int col = colStart; col < colEnd; col++)
+			{
+				int pixel = row * imgWidth + col;
+				int count = film.sampleCount(pixel);
+
+				while (count < limit)
+				{
+					if (adaptive() && count >= adaptiveMinSpp && film.relativeError(pixel) <= adaptiveTargetError)
+						break;
+
+					int target = std::min(count + batch, limit);
+					taken += target - count;
+
+					for (; count < target; count++)
+						film.addSample(pixel, samplePixel(hittables, lights, materials, row, col, sampleBegin + count, sampler));
+				}
+			}
+		}
+
+		return taken;
+	}
+
 	std::vector<unsigned char> img;
+	std::vector<float> hdr;
 	int imgWidth, imgHeight;
 	Point pixel00Pos, cameraOrigin;
 	Vec deltaV, deltaU;
@@ -210,7 +606,19 @@ private:
 
 	Color background;
 
-	Random rand;
+	uint32_t samplerSeed;
+
+	int threadCount;
+	int tileSize;
+	SamplerType samplerType;
+
+	double adaptiveTargetError;
+	int adaptiveMinSpp, adaptiveMaxSpp;
+
+	int progressivePassSpp;
+	std::string checkpointPath;
+	int processCount;
 
-	double mixturePDFRatio;
+	int rouletteDepth;
+	double rouletteMinSurvival, rouletteMaxSurvival;
 };
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include "Film.h"
+
+// Everything besides the film needed to pick a render back up. Sample numbers are addressed by
+// (pixel, sample index) off the seed, so the seed and each pixel's sample count pin down exactly
+// where every pixel's random sequence continues.
+struct CheckpointHeader
+{
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint32_t samplerType = 0;
+	uint32_t samplerSpp = 0;
+	uint64_t seed = 0;
+};
+
+/// <summary>
+/// Binary snapshot of a progressive render: magic, version, header, then the film's accumulators.
+/// Saving writes a temporary file next to the target and renames it over the old checkpoint, so
+/// a render killed mid-save still leaves the previous checkpoint intact.
+/// </summary>
+class Checkpoint
+{
+public:
+	static void save(const std::string& path, const CheckpointHeader& header, const Film& film)
+	{
+		std::string tempPath = path + ".tmp";
+
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+				throw std::runtime_error("Cannot write checkpoint " + tempPath);
+
+			out.write(Magic, sizeof(Magic));
+			out.write(reinterpret_cast<const char*>(&Version), sizeof(Version));
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			film.write(out);
+
+			if (!out.flush())
+				throw std::runtime_error("Cannot write checkpoint " + tempPath);
+		}
+
+		std::filesystem::rename(tempPath, path);
+	}
+
+	/// <summary>
+	/// Fills header and film from path. Returns false if there is no checkpoint there; throws if
+	/// there is one but it is not a readable checkpoint for a film of this size.
+	/// </summary>
+	static bool load(const std::string& path, CheckpointHeader& header, Film& film)
+	{
+		std::ifstream in(path, std::ios::binary);
+		if (!in)
+			return false;
+
+		char magic[sizeof(Magic)];
+		uint32_t version = 0;
+		in.read(magic, sizeof(magic));
+		in.read(reinterpret_cast<char*>(&version), sizeof(version));
+		in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+		if (!in || std::memcmp(magic, Magic, sizeof(Magic)) != 0 || version != Version)
+			throw std::runtime_error("Not a checkpoint: " + path);
+
+		if (header.width != (uint32_t)film.width() || header.height != (uint32_t)film.height())
+			throw std::runtime_error("Checkpoint " + path + " is for a different image size");
+
+		if (!film.read(in))
+			throw std::runtime_error("Truncated checkpoint: " + path);
+
+		return true;
+	}
+
+private:
+	static constexpr char Magic[4] = { 'R', 'T', 'C', 'K' };
+	static constexpr uint32_t Version = 1;
+};
@@ -2,4 +2,10 @@
 
 #include <glm/glm.hpp>
 
-using Color = glm::vec<3, double>;
\ No newline at end of file
+using Color = glm::vec<3, double>;
+
+// Rec. 709 luminance of a linear color
+inline double luminance(const Color& color)
+{
+	return 0.2126 * color.x + 0.7152 * color.y + 0.0722 * color.z;
+}
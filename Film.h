@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+#include "Color.h"
+
+/// <summary>
+/// Linear radiance accumulated per pixel. Besides the color sum every pixel keeps a running mean and
+/// variance of its luminance (Welford), which is what adaptive sampling uses to judge convergence.
+/// Pixels are only ever touched by the tile that owns them, so no locking.
+/// </summary>
+class Film
+{
+public:
+	Film(int width, int height) : filmWidth(width), filmHeight(height), pixels((size_t)width * height)
+	{
+	}
+
+	void addSample(int pixel, const Color& radiance)
+	{
+		Pixel& p = pixels[pixel];
+		p.sum += radiance;
+		p.count++;
+
+		double lum = luminance(radiance);
+		double delta = lum - p.lumMean;
+		p.lumMean += delta / p.count;
+		p.lumM2 += delta * (lum - p.lumMean);
+	}
+
+	Color mean(int pixel) const
+	{
+		const Pixel& p = pixels[pixel];
+		return p.count > 0 ? p.sum / (double)p.count : Color(0, 0, 0);
+	}
+
+	int sampleCount(int pixel) const
+	{
+		return pixels[pixel].count;
+	}
+
+	/// <summary>
+	/// Standard error of the pixel's mean luminance relative to that mean. Dark pixels are measured
+	/// against MinLuminance instead so they are not refined forever chasing noise nobody can see.
+	/// </summary>
+	double relativeError(int pixel) const
+	{
+		const Pixel& p = pixels[pixel];
+
+		if (p.count < 2)
+			return std::numeric_limits<double>::infinity();
+
+		double variance = p.lumM2 / (p.count - 1);
+		return std::sqrt(variance / p.count) / std::max(p.lumMean, MinLuminance);
+	}
+
+	long long totalSamples() const
+	{
+		long long total = 0;
+		for (auto& p : pixels)
+			total += p.count;
+		return total;
+	}
+
+	int width() const { return filmWidth; }
+	int height() const { return filmHeight; }
+
+	/// <summary>
+	/// Adds another film's samples of the same pixels, as if they had been taken here. The luminance
+	/// statistics combine with Chan et al.'s pairwise update, so merging partial renders in a fixed
+	/// order always gives the same result.
+	/// </summary>
+	void merge(const Film& other)
+	{
+		for (size_t i = 0; i < pixels.size(); i++)
+		{
+			Pixel& p = pixels[i];
+			const Pixel& q = other.pixels[i];
+
+			if (q.count == 0)
+				continue;
+
+			int count = p.count + q.count;
+			double delta = q.lumMean - p.lumMean;
+
+			p.sum += q.sum;
+			p.lumMean += delta * q.count / count;
+			p.lumM2 += q.lumM2 + delta * delta * ((double)p.count * q.count / count);
+			p.count = count;
+		}
+	}
+
+	// Raw dump of every accumulator in native byte order, for checkpoints.
+	void write(std::ostream& out) const
+	{
+		for (auto& p : pixels)
+		{
+			writeValue(out, p.sum.x);
+			writeValue(out, p.sum.y);
+			writeValue(out, p.sum.z);
+			writeValue(out, p.count);
+			writeValue(out, p.lumMean);
+			writeValue(out, p.lumM2);
+		}
+	}
+
+	// Counterpart of write for a film of the same size. False if the stream runs out.
+	bool read(std::istream& in)
+	{
+		for (auto& p : pixels)
+		{
+			readValue(in, p.sum.x);
+			readValue(in, p.sum.y);
+			readValue(in, p.sum.z);
+			readValue(in, p.count);
+			readValue(in, p.lumMean);
+			readValue(in, p.lumM2);
+		}
+		return (bool)in;
+	}
+
+private:
+	static constexpr double MinLuminance = 1e-2;
+
+	struct Pixel
+	{
+		Color sum = Color(0, 0, 0);
+		int count = 0;
+		double lumMean = 0;
+		double lumM2 = 0; // sum of squared deviations from lumMean
+	};
+
+	int filmWidth, filmHeight;
+	std::vector<Pixel> pixels;
+
+	template <typename T>
+	static void writeValue(std::ostream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	static void readValue(std::istream& in, T& value)
+	{
+		in.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+};
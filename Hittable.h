@@ -1,10 +1,17 @@
 #pragma once
 #include "Ray.h"
 #include "Interval.h"
+#include "Aabb.h"
+#include "LightBounds.h"
 #include <memory>
-#include "Random.h"
+#include <cstdint>
+#include "Sampler.h"
 
-class Material;
+// index into the scene's MaterialTable
+using MaterialId = uint32_t;
+
+class Hittable;
+class MaterialTable;
 
 class Hit
 {
@@ -13,7 +20,8 @@ public:
 	Vec normal;
 	double t;
 	bool frontface;
-	std::shared_ptr<Material> mat;
+	MaterialId mat;
+	const Hittable* object; // primitive that was hit, lets light sampling find the light it belongs to
 
 	void setFaceNormal(const Ray& ray, const Vec& outNorm)
 	{
@@ -29,6 +37,14 @@ class Hittable
 
 		virtual bool hit(const Ray& ray, const Interval& interval, Hit& hit) const = 0;
 
+		/// <summary>
+		/// Whether anything blocks the ray within interval. Stops at the first intersection found
+		/// and skips the normal / material work of hit(), for shadow and visibility rays.
+		/// </summary>
+		virtual bool occluded(const Ray& ray, const Interval& interval) const = 0;
+
+		virtual Aabb boundingBox() const = 0;
+
 		// Watch out for divide by zero error if pdf = 0.
 		// Just make sure that randomSample always returns a direction
 		// that actually hits the surface of this
@@ -36,7 +52,16 @@ class Hittable
 		/// <summary>
 		/// Sample random direction to hittable from origin.
 		/// </summary>
-		/// <param name="rand"></param>
+		/// <param name="sampler"></param>
 		/// <returns></returns>
-		virtual Vec randomSample(Random& rand, const Point& origin) const = 0;
+		virtual Vec randomSample(Sampler& sampler, const Point& origin) const = 0;
+
+		/// <summary>
+		/// Total power emitted by this hittable (area times emitted radiance, up to a constant factor),
+		/// used to decide how often it gets sampled as a light. Zero for anything that does not emit.
+		/// </summary>
+		virtual double power(const MaterialTable& materials) const = 0;
+
+		// where and in which directions this hittable emits, for building a light hierarchy
+		virtual LightBounds lightBounds(const MaterialTable& materials) const = 0;
 };
@@ -24,10 +24,32 @@ public:
 		}
 		return hitValid;
 	}
+	bool occluded(const Ray& ray, const Interval& interval) const override
+	{
+		for (auto& hittable : hittables)
+		{
+			if (hittable->occluded(ray, interval))
+				return true;
+		}
+		return false;
+	}
 	void add(std::shared_ptr<Hittable> hittable)
 	{
 		hittables.push_back(hittable);
 	}
+	Aabb boundingBox() const override
+	{
+		Aabb box;
+
+		for (auto& hittable : hittables)
+			box.grow(hittable->boundingBox());
+
+		return box;
+	}
+	const std::vector<std::shared_ptr<Hittable>>& objects() const
+	{
+		return hittables;
+	}
 	double pdf(const Point& origin, const Point& dir) const
 	{
 		int len = hittables.size();
@@ -42,12 +64,32 @@ public:
 		return sum / len;
 	}
 	
-	Vec randomSample(Random& rand, const Point& origin) const
+	double power(const MaterialTable& materials) const override
+	{
+		double sum = 0;
+
+		for (auto& hittable : hittables)
+			sum += hittable->power(materials);
+
+		return sum;
+	}
+
+	LightBounds lightBounds(const MaterialTable& materials) const override
+	{
+		LightBounds bounds;
+
+		for (auto& hittable : hittables)
+			bounds = LightBounds::merge(bounds, hittable->lightBounds(materials));
+
+		return bounds;
+	}
+
+	Vec randomSample(Sampler& sampler, const Point& origin) const
 	{
 		int len = hittables.size();
-		int index = (int) rand.randomDouble(0, len);
+		int index = std::min((int)(sampler.get1D() * len), len - 1);
 
-		return hittables.at(index)->randomSample(rand, origin);
+		return hittables.at(index)->randomSample(sampler, origin);
 	}
 private:
 	std::vector<std::shared_ptr<Hittable>> hittables;
@@ -0,0 +1,149 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Lossless writers for linear RGB32F buffers (row-major, top row first, 3 floats per pixel), to sit
+// next to stbi_write_jpg for anything that needs the unclamped radiance: re-exposing, merging
+// renders, denoising. Both return true on success, like the stb writers return nonzero.
+
+namespace imageio_detail
+{
+	inline void putU32(std::vector<char>& out, uint32_t v)
+	{
+		for (int i = 0; i < 4; i++)
+			out.push_back((char)((v >> (8 * i)) & 0xff));
+	}
+
+	inline void putU64(std::vector<char>& out, uint64_t v)
+	{
+		for (int i = 0; i < 8; i++)
+			out.push_back((char)((v >> (8 * i)) & 0xff));
+	}
+
+	inline void putF32(std::vector<char>& out, float f)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		putU32(out, bits);
+	}
+
+	inline void putString(std::vector<char>& out, const char* s)
+	{
+		out.insert(out.end(), s, s + std::strlen(s) + 1);
+	}
+
+	inline void putAttribute(std::vector<char>& out, const char* name, const char* type, const std::vector<char>& value)
+	{
+		putString(out, name);
+		putString(out, type);
+		putU32(out, (uint32_t)value.size());
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	inline bool writeFile(const std::string& path, const std::vector<char>& bytes)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), bytes.size());
+		return (bool)file;
+	}
+}
+
+/// <summary>
+/// Portable float map: text header, then little-endian float rows from the bottom of the image up
+/// (the negative scale marks little-endian).
+/// </summary>
+inline bool writePfm(const std::string& path, int width, int height, const float* rgb)
+{
+	using namespace imageio_detail;
+
+	std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+	std::vector<char> bytes(header.begin(), header.end());
+	bytes.reserve(bytes.size() + (size_t)width * height * 12);
+
+	for (int row = height - 1; row >= 0; row--)
+	{
+		for (int i = 0; i < width * 3; i++)
+			putF32(bytes, rgb[(size_t)row * width * 3 + i]);
+	}
+
+	return writeFile(path, bytes);
+}
+
+/// <summary>
+/// Single-part scanline OpenEXR with no compression and FLOAT B, G, R channels: magic and version,
+/// header attributes, an offset table with one entry per scanline, then each scanline as its y,
+/// its byte count and the channels one after another (channels are stored in name order).
+/// </summary>
+inline bool writeExr(const std::string& path, int width, int height, const float* rgb)
+{
+	using namespace imageio_detail;
+
+	std::vector<char> bytes;
+	putU32(bytes, 20000630); // magic
+	putU32(bytes, 2); // version 2, single-part scanline
+
+	std::vector<char> channels;
+	for (const char* name : { "B", "G", "R" })
+	{
+		putString(channels, name);
+		putU32(channels, 2); // FLOAT
+		putU32(channels, 0); // pLinear and reserved
+		putU32(channels, 1); // x sampling
+		putU32(channels, 1); // y sampling
+	}
+	channels.push_back(0);
+	putAttribute(bytes, "channels", "chlist", channels);
+
+	putAttribute(bytes, "compression", "compression", { 0 }); // NO_COMPRESSION
+
+	std::vector<char> window;
+	putU32(window, 0);
+	putU32(window, 0);
+	putU32(window, width - 1);
+	putU32(window, height - 1);
+	putAttribute(bytes, "dataWindow", "box2i", window);
+	putAttribute(bytes, "displayWindow", "box2i", window);
+
+	putAttribute(bytes, "lineOrder", "lineOrder", { 0 }); // INCREASING_Y
+
+	std::vector<char> one;
+	putF32(one, 1.0f);
+	putAttribute(bytes, "pixelAspectRatio", "float", one);
+	putAttribute(bytes, "screenWindowWidth", "float", one);
+
+	std::vector<char> center;
+	putF32(center, 0.0f);
+	putF32(center, 0.0f);
+	putAttribute(bytes, "screenWindowCenter", "v2f", center);
+
+	bytes.push_back(0); // end of header
+
+	uint32_t lineBytes = (uint32_t)width * 3 * sizeof(float);
+	uint64_t offset = bytes.size() + (uint64_t)height * 8;
+
+	for (int row = 0; row < height; row++)
+	{
+		putU64(bytes, offset);
+		offset += 8 + lineBytes;
+	}
+
+	bytes.reserve(offset);
+
+	for (int row = 0; row < height; row++)
+	{
+		putU32(bytes, (uint32_t)row);
+		putU32(bytes, lineBytes);
+
+		const float* line = rgb + (size_t)row * width * 3;
+		for (int channel : { 2, 1, 0 })
+		{
+			for (int col = 0; col < width; col++)
+				putF32(bytes, line[3 * col + channel]);
+		}
+	}
+
+	return writeFile(path, bytes);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cmath>
+#include <memory>
+
+#include "Hittable.h"
+#include "Transform.h"
+
+/// <summary>
+/// A placed copy of shared geometry. object is the bottom level: any Hittable, usually a Bvh or
+/// TriangleMesh over one model, built once and referenced by every instance of it. The instance
+/// only keeps the pointer and an object-to-world transform, and intersects by moving the ray into
+/// object space, so memory grows with the unique geometry rather than with the number of copies.
+/// A scene Bvh over instances is the top level.
+///
+/// As a light the instance samples its object in object space and maps the direction back; the
+/// pdf picks up the change of solid angle under the linear part. Power and light bounds are exact
+/// for rotations, translations and uniform scales, and conservative for other transforms.
+/// </summary>
+class Instance : public Hittable
+{
+public:
+	Instance(std::shared_ptr<const Hittable> object, const Transform& toWorld)
+		: object(std::move(object)), toWorld(toWorld), worldBounds(toWorld.bounds(this->object->boundingBox()))
+	{
+	}
+
+	bool hit(const Ray& ray, const Interval& interval, Hit& hit) const override
+	{
+		// object space distances along the ray are scale times the world ones
+		Vec localDir = toWorld.inverseVector(ray.dir());
+		double scale = glm::length(localDir);
+		Ray local(toWorld.inversePoint(ray.origin()), localDir);
+
+		if (!object->hit(local, Interval(interval.min * scale, interval.max * scale), hit))
+			return false;
+
+		hit.t /= scale;
+		hit.pos = ray.at(hit.t);
+		// the inverse transpose keeps the normal's side of the surface, so frontface still holds
+		hit.normal = glm::normalize(toWorld.normal(hit.normal));
+		hit.object = this;
+		return true;
+	}
+
+	bool occluded(const Ray& ray, const Interval& interval) const override
+	{
+		Vec localDir = toWorld.inverseVector(ray.dir());
+		double scale = glm::length(localDir);
+		Ray local(toWorld.inversePoint(ray.origin()), localDir);
+
+		return object->occluded(local, Interval(interval.min * scale, interval.max * scale));
+	}
+
+	Aabb boundingBox() const override
+	{
+		return worldBounds;
+	}
+
+	/// <summary>
+	/// Density of a world direction w from the object's density of w' = A w / |A w|, A the inverse
+	/// linear part: solid angle scales by |det A| / |A w|^3.
+	/// </summary>
+	double pdf(const Point& origin, const Point& dir) const override
+	{
+		Vec localDir = toWorld.inverseVector(glm::normalize(dir));
+		double len = glm::length(localDir);
+
+		double localPdf = object->pdf(toWorld.inversePoint(origin), localDir / len);
+		return localPdf * std::fabs(1 / toWorld.determinant()) / (len * len * len);
+	}
+
+	Vec randomSample(Sampler& sampler, const Point& origin) const override
+	{
+		Vec localDir = object->randomSample(sampler, toWorld.inversePoint(origin));
+		return glm::normalize(toWorld.vector(localDir));
+	}
+
+	double power(const MaterialTable& materials) const override
+	{
+		// areas scale by s^2 under a uniform scale s
+		return object->power(materials) * std::pow(std::fabs(toWorld.determinant()), 2.0 / 3.0);
+	}
+
+	LightBounds lightBounds(const MaterialTable& materials) const override
+	{
+		LightBounds bounds = object->lightBounds(materials);
+		bounds.bounds = toWorld.bounds(bounds.bounds);
+		bounds.w = glm::normalize(toWorld.normal(bounds.w));
+		bounds.phi = power(materials);
+
+		// a non-uniform scale bends the normal cone, so let it cover every direction
+		if (!toWorld.isSimilarity())
+			bounds.cosThetaO = -1;
+
+		return bounds;
+	}
+
+	const std::shared_ptr<const Hittable>& shared() const { return object; }
+	const Transform& transform() const { return toWorld; }
+
+private:
+	std::shared_ptr<const Hittable> object;
+	Transform toWorld;
+	Aabb worldBounds;
+};
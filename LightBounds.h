@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include "Aabb.h"
+#include "RayTracing.h"
+
+/// <summary>
+/// Spatial and directional extent of one or more emitters, as used to estimate how much they can
+/// contribute at a shading point. Emission leaves the box within the cone of normals around w with
+/// half angle acos(cosThetaO), spreading at most acos(cosThetaE) further out from each normal.
+/// </summary>
+class LightBounds
+{
+public:
+	Aabb bounds;
+	Vec w = Vec(0, 0, 1);
+	double phi = 0; // emitted power
+	double cosThetaO = 1;
+	double cosThetaE = 0;
+
+	LightBounds() = default;
+
+	LightBounds(const Aabb& bounds, const Vec& w, double phi, double cosThetaO, double cosThetaE)
+		: bounds(bounds), w(w), phi(phi), cosThetaO(cosThetaO), cosThetaE(cosThetaE)
+	{
+	}
+
+	Point centroid() const
+	{
+		return bounds.centroid();
+	}
+
+	/// <summary>
+	/// Conservative estimate of the power arriving at p from everything inside these bounds:
+	/// falls off with squared distance and drops to zero once p lies outside every emitted direction.
+	/// </summary>
+	double importance(const Point& p) const
+	{
+		Point pc = bounds.centroid();
+		Vec toP = p - pc;
+		double d2 = glm::dot(toP, toP);
+
+		// don't let points inside or close to the box blow up
+		d2 = std::max(d2, glm::length(bounds.extent()) / 2);
+
+		double len = std::sqrt(glm::dot(toP, toP));
+		double cosThetaW = len > 0 ? glm::dot(toP / len, w) : 1.0;
+		double sinThetaW = safeSqrt(1 - cosThetaW * cosThetaW);
+
+		// angle the box subtends as seen from p
+		double cosThetaB = boundSubtendedCos(p);
+		double sinThetaB = safeSqrt(1 - cosThetaB * cosThetaB);
+
+		// cos(max(0, thetaW - thetaO - thetaB)): smallest angle between p and an emitting normal
+		double sinThetaO = safeSqrt(1 - cosThetaO * cosThetaO);
+		double cosThetaX = cosSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+		double sinThetaX = sinSubClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+		double cosThetaP = cosSubClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+
+		if (cosThetaP <= cosThetaE)
+			return 0;
+
+		return phi * cosThetaP / d2;
+	}
+
+	static LightBounds merge(const LightBounds& a, const LightBounds& b)
+	{
+		if (a.phi == 0)
+			return b;
+		if (b.phi == 0)
+			return a;
+
+		LightBounds result;
+		result.bounds = a.bounds;
+		result.bounds.grow(b.bounds);
+		result.phi = a.phi + b.phi;
+		result.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+		mergeCones(a.w, a.cosThetaO, b.w, b.cosThetaO, result.w, result.cosThetaO);
+		return result;
+	}
+
+private:
+	static double safeSqrt(double x)
+	{
+		return std::sqrt(std::max(0.0, x));
+	}
+
+	static double safeAcos(double x)
+	{
+		return std::acos(std::clamp(x, -1.0, 1.0));
+	}
+
+	// cos(max(0, a - b)) from the sines and cosines of a and b
+	static double cosSubClamped(double sinA, double cosA, double sinB, double cosB)
+	{
+		if (cosA > cosB)
+			return 1;
+		return cosA * cosB + sinA * sinB;
+	}
+
+	// sin(max(0, a - b))
+	static double sinSubClamped(double sinA, double cosA, double sinB, double cosB)
+	{
+		if (cosA > cosB)
+			return 0;
+		return sinA * cosB - cosA * sinB;
+	}
+
+	// cosine of the half angle of the cone from p that contains the box's bounding sphere
+	double boundSubtendedCos(const Point& p) const
+	{
+		Point center = bounds.centroid();
+		double radius2 = glm::dot(bounds.extent(), bounds.extent()) / 4;
+		double dist2 = glm::dot(p - center, p - center);
+
+		if (dist2 < radius2)
+			return -1;
+
+		return safeSqrt(1 - radius2 / dist2);
+	}
+
+	// smallest cone containing both cones (a, cosA) and (b, cosB)
+	static void mergeCones(const Vec& a, double cosA, const Vec& b, double cosB, Vec& w, double& cosTheta)
+	{
+		double thetaA = safeAcos(cosA);
+		double thetaB = safeAcos(cosB);
+		double thetaD = safeAcos(glm::dot(a, b));
+
+		if (std::min(thetaD + thetaB, pi) <= thetaA)
+		{
+			w = a;
+			cosTheta = cosA;
+			return;
+		}
+		if (std::min(thetaD + thetaA, pi) <= thetaB)
+		{
+			w = b;
+			cosTheta = cosB;
+			return;
+		}
+
+		double thetaO = (thetaA + thetaD + thetaB) / 2;
+		Vec axis = glm::cross(a, b);
+
+		if (thetaO >= pi || glm::dot(axis, axis) < 1e-16)
+		{
+			w = a;
+			cosTheta = -1;
+			return;
+		}
+
+		// rotate a toward b by thetaO - thetaA (Rodrigues)
+		double thetaR = thetaO - thetaA;
+		axis = glm::normalize(axis);
+		w = a * std::cos(thetaR) + glm::cross(axis, a) * std::sin(thetaR) + axis * glm::dot(axis, a) * (1 - std::cos(thetaR));
+		w = glm::normalize(w);
+		cosTheta = std::cos(thetaO);
+	}
+};
@@ -0,0 +1,422 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "HittableList.h"
+#include "Material.h"
+
+struct LightSample
+{
+	const Hittable* light; // nullptr if there is nothing to sample
+	double pmf; // probability of having picked light
+};
+
+/// <summary>
+/// Chooses which light next-event estimation samples from a shading point. The direction toward
+/// the chosen light is then sampled by the light itself (Hittable::randomSample / pdf), so the
+/// full light pdf of a direction is pmf(origin, light) * light->pdf(origin, dir).
+/// </summary>
+class LightSampler
+{
+public:
+	virtual ~LightSampler() = default;
+
+	virtual LightSample sample(const Point& origin, Sampler& sampler) const = 0;
+
+	// probability that sample(origin) picks light, 0 for anything that is not one of the lights
+	virtual double pmf(const Point& origin, const Hittable* light) const = 0;
+};
+
+// Every light equally likely, regardless of how much it emits.
+class UniformLightSampler : public LightSampler
+{
+public:
+	UniformLightSampler(const HittableList& lights)
+	{
+		for (auto& light : lights.objects())
+			this->lights.push_back(light.get());
+	}
+
+	LightSample sample(const Point& origin, Sampler& sampler) const override
+	{
+		if (lights.empty())
+			return { nullptr, 0 };
+
+		int index = std::min((int)(sampler.get1D() * lights.size()), (int)lights.size() - 1);
+		return { lights[index], 1.0 / lights.size() };
+	}
+
+	double pmf(const Point& origin, const Hittable* light) const override
+	{
+		return std::find(lights.begin(), lights.end(), light) != lights.end() ? 1.0 / lights.size() : 0.0;
+	}
+
+private:
+	std::vector<const Hittable*> lights;
+};
+
+/// <summary>
+/// Picks lights in proportion to their emitted power (Hittable::power), in O(1) through an alias
+/// table: every slot holds a threshold and an alias, one uniform number picks a slot and then either
+/// the slot's own light or its alias. pmf of a given light is a hash lookup.
+/// </summary>
+class PowerLightSampler : public LightSampler
+{
+public:
+	PowerLightSampler(const HittableList& lights, const MaterialTable& materials)
+	{
+		std::vector<double> weights;
+		double total = 0;
+
+		for (auto& light : lights.objects())
+		{
+			this->lights.push_back(light.get());
+			weights.push_back(light->power(materials));
+			total += weights.back();
+		}
+
+		int count = (int)this->lights.size();
+
+		// nothing emits, so nothing to prefer
+		if (total <= 0)
+		{
+			weights.assign(count, 1.0);
+			total = count;
+		}
+
+		probs.resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			probs[i] = weights[i] / total;
+			index[this->lights[i]] = i;
+		}
+
+		buildAliasTable();
+	}
+
+	LightSample sample(const Point& origin, Sampler& sampler) const override
+	{
+		if (lights.empty())
+			return { nullptr, 0 };
+
+		double u = sampler.get1D() * slots.size();
+		int slot = std::min((int)u, (int)slots.size() - 1);
+
+		int picked = (u - slot) < slots[slot].threshold ? slot : slots[slot].alias;
+		return { lights[picked], probs[picked] };
+	}
+
+	double pmf(const Point& origin, const Hittable* light) const override
+	{
+		auto it = index.find(light);
+		return it != index.end() ? probs[it->second] : 0.0;
+	}
+
+private:
+	struct Slot
+	{
+		double threshold;
+		int alias;
+	};
+
+	std::vector<const Hittable*> lights;
+	std::vector<double> probs;
+	std::vector<Slot> slots;
+	std::unordered_map<const Hittable*, int> index;
+
+	// Vose's method: pair each under-full slot with an over-full one until all hold exactly 1 / n
+	void buildAliasTable()
+	{
+		int count = (int)probs.size();
+		slots.resize(count);
+
+		std::vector<double> scaled(count);
+		std::vector<int> small, large;
+
+		for (int i = 0; i < count; i++)
+		{
+			scaled[i] = probs[i] * count;
+			(scaled[i] < 1.0 ? small : large).push_back(i);
+		}
+
+		while (!small.empty() && !large.empty())
+		{
+			int under = small.back();
+			small.pop_back();
+			int over = large.back();
+
+			slots[under] = { scaled[under], over };
+			scaled[over] -= 1.0 - scaled[under];
+
+			if (scaled[over] < 1.0)
+			{
+				large.pop_back();
+				small.push_back(over);
+			}
+		}
+
+		// leftovers are full up to rounding error
+		for (int i : small)
+			slots[i] = { 1.0, i };
+		for (int i : large)
+			slots[i] = { 1.0, i };
+	}
+};
+
+/// <summary>
+/// Hierarchy over the lights, built like Bvh but every node also carries an orientation cone and the
+/// total power below it (LightBounds). Sampling walks from the root and at each interior node descends
+/// into a child with probability proportional to its importance at the shading point, so lights that
+/// are near, bright and facing the point are preferred. pmf retraces the same path from the light's
+/// bit trail (one bit per level, 1 = second child) in O(depth) rather than searching the tree.
+/// Lights that emit nothing are left out and have pmf 0.
+/// </summary>
+class LightBvh : public LightSampler
+{
+public:
+	LightBvh(const HittableList& lights, const MaterialTable& materials)
+	{
+		std::vector<Primitive> prims;
+
+		for (auto& light : lights.objects())
+		{
+			LightBounds bounds = light->lightBounds(materials);
+			if (bounds.phi > 0)
+			{
+				prims.push_back({ bounds, (int)this->lights.size() });
+				this->lights.push_back(light.get());
+			}
+		}
+
+		if (!prims.empty())
+		{
+			nodes.reserve(2 * prims.size() - 1);
+			build(prims, 0, (int)prims.size(), 0, 0);
+		}
+	}
+
+	LightSample sample(const Point& origin, Sampler& sampler) const override
+	{
+		if (nodes.empty())
+			return { nullptr, 0 };
+
+		double u = sampler.get1D();
+		double pmf = 1;
+		int nodeIndex = 0;
+
+		while (!nodes[nodeIndex].isLeaf)
+		{
+			int first = nodeIndex + 1;
+			int second = nodes[nodeIndex].index;
+			double importance0 = nodes[first].bounds.importance(origin);
+			double importance1 = nodes[second].bounds.importance(origin);
+
+			if (importance0 == 0 && importance1 == 0)
+				return { nullptr, 0 };
+
+			// pick a child and rescale u back to [0, 1) so it can be reused on the next level
+			double p0 = importance0 / (importance0 + importance1);
+			if (u < p0)
+			{
+				u = std::min(u / p0, OneMinusEpsilon);
+				pmf *= p0;
+				nodeIndex = first;
+			}
+			else
+			{
+				u = std::min((u - p0) / (1 - p0), OneMinusEpsilon);
+				pmf *= importance1 / (importance0 + importance1); // same expression as pmf() uses
+				nodeIndex = second;
+			}
+		}
+
+		// a lone light at the root has no sibling to compete with, but may still face away
+		if (nodeIndex == 0 && nodes[0].bounds.importance(origin) == 0)
+			return { nullptr, 0 };
+
+		return { lights[nodes[nodeIndex].index], pmf };
+	}
+
+	double pmf(const Point& origin, const Hittable* light) const override
+	{
+		auto it = bitTrails.find(light);
+		if (it == bitTrails.end())
+			return 0.0;
+
+		uint64_t trail = it->second;
+		double pmf = 1;
+		int nodeIndex = 0;
+
+		while (!nodes[nodeIndex].isLeaf)
+		{
+			int first = nodeIndex + 1;
+			int second = nodes[nodeIndex].index;
+			double importance0 = nodes[first].bounds.importance(origin);
+			double importance1 = nodes[second].bounds.importance(origin);
+
+			if (importance0 == 0 && importance1 == 0)
+				return 0.0;
+
+			bool takeSecond = trail & 1;
+			pmf *= (takeSecond ? importance1 : importance0) / (importance0 + importance1);
+			nodeIndex = takeSecond ? second : first;
+			trail >>= 1;
+		}
+
+		if (nodeIndex == 0 && nodes[0].bounds.importance(origin) == 0)
+			return 0.0;
+
+		return pmf;
+	}
+
+	size_t nodeCount() const
+	{
+		return nodes.size();
+	}
+
+private:
+	static constexpr int BinCount = 12;
+	static constexpr int MaxSahDepth = 32; // past this, split in halves so bit trails fit in 64 bits
+	static constexpr double OneMinusEpsilon = 1.0 - std::numeric_limits<double>::epsilon() / 2;
+
+	struct Primitive
+	{
+		LightBounds bounds;
+		int light;
+	};
+
+	// same layout idea as BvhNode: first child follows its parent, index is the second child or the light
+	struct Node
+	{
+		LightBounds bounds;
+		int index;
+		bool isLeaf;
+	};
+
+	std::vector<const Hittable*> lights;
+	std::vector<Node> nodes;
+	std::unordered_map<const Hittable*, uint64_t> bitTrails;
+
+	int build(std::vector<Primitive>& prims, int begin, int end, uint64_t trail, int depth)
+	{
+		int nodeIndex = (int)nodes.size();
+		nodes.push_back({});
+
+		if (end - begin == 1)
+		{
+			nodes[nodeIndex] = { prims[begin].bounds, prims[begin].light, true };
+			bitTrails[lights[prims[begin].light]] = trail;
+			return nodeIndex;
+		}
+
+		int mid = depth < MaxSahDepth ? splitByCost(prims, begin, end) : -1;
+
+		if (mid < 0)
+		{
+			Aabb centroids;
+			for (int i = begin; i < end; i++)
+				centroids.grow(prims[i].bounds.centroid());
+
+			int axis = centroids.longestAxis();
+			mid = (begin + end) / 2;
+			std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+				[axis](const Primitive& a, const Primitive& b) { return a.bounds.centroid()[axis] < b.bounds.centroid()[axis]; });
+		}
+
+		build(prims, begin, mid, trail, depth + 1);
+		int second = build(prims, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+
+		nodes[nodeIndex] = { LightBounds::merge(nodes[nodeIndex + 1].bounds, nodes[second].bounds), second, false };
+		return nodeIndex;
+	}
+
+	// Binned split minimizing power * orientation measure * surface area over all three axes.
+	// Returns the partition point, or -1 if the centroids can't be told apart.
+	int splitByCost(std::vector<Primitive>& prims, int begin, int end) const
+	{
+		Aabb bounds, centroids;
+		for (int i = begin; i < end; i++)
+		{
+			bounds.grow(prims[i].bounds.bounds);
+			centroids.grow(prims[i].bounds.centroid());
+		}
+
+		Vec diagonal = bounds.extent();
+		double maxExtent = std::max({ diagonal.x, diagonal.y, diagonal.z });
+
+		double bestCost = std::numeric_limits<double>::max();
+		int bestAxis = -1, bestBin = -1;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double lo = centroids.min[axis];
+			double hi = centroids.max[axis];
+			if (hi <= lo)
+				continue;
+
+			LightBounds bins[BinCount];
+			for (int i = begin; i < end; i++)
+			{
+				int bin = binIndex(prims[i].bounds.centroid()[axis], lo, hi);
+				bins[bin] = LightBounds::merge(bins[bin], prims[i].bounds);
+			}
+
+			// longer axes are cheaper to split along, flat slabs would otherwise always win
+			double kr = diagonal[axis] > 0 ? maxExtent / diagonal[axis] : 1;
+
+			for (int split = 0; split < BinCount - 1; split++)
+			{
+				LightBounds below, above;
+				for (int b = 0; b <= split; b++)
+					below = LightBounds::merge(below, bins[b]);
+				for (int b = split + 1; b < BinCount; b++)
+					above = LightBounds::merge(above, bins[b]);
+
+				double splitCost = kr * (cost(below) + cost(above));
+				if (splitCost < bestCost)
+				{
+					bestCost = splitCost;
+					bestAxis = axis;
+					bestBin = split;
+				}
+			}
+		}
+
+		if (bestAxis < 0)
+			return -1;
+
+		double lo = centroids.min[bestAxis];
+		double hi = centroids.max[bestAxis];
+		auto it = std::partition(prims.begin() + begin, prims.begin() + end,
+			[&](const Primitive& p) { return binIndex(p.bounds.centroid()[bestAxis], lo, hi) <= bestBin; });
+
+		int mid = (int)(it - prims.begin());
+		return (mid == begin || mid == end) ? -1 : mid;
+	}
+
+	static int binIndex(double value, double lo, double hi)
+	{
+		int bin = (int)(BinCount * (value - lo) / (hi - lo));
+		return std::clamp(bin, 0, BinCount - 1);
+	}
+
+	// solid angle measure of the directions the bounds can emit into, times power and box area
+	static double cost(const LightBounds& b)
+	{
+		if (b.phi == 0)
+			return 0;
+
+		double thetaO = std::acos(std::clamp(b.cosThetaO, -1.0, 1.0));
+		double thetaE = std::acos(std::clamp(b.cosThetaE, -1.0, 1.0));
+		double thetaW = std::min(thetaO + thetaE, pi);
+		double sinThetaO = std::sqrt(std::max(0.0, 1 - b.cosThetaO * b.cosThetaO));
+
+		double mOmega = 2 * pi * (1 - b.cosThetaO)
+			+ pi / 2 * (2 * thetaW * sinThetaO - std::cos(thetaO - 2 * thetaW) - 2 * thetaO * sinThetaO + b.cosThetaO);
+
+		return b.phi * mOmega * b.bounds.surfaceArea();
+	}
+};
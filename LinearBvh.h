@@ -0,0 +1,569 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "Aabb.h"
+
+/// <summary>
+/// Builds a bounding volume hierarchy over a set of primitive bounds with the surface area heuristic,
+/// evaluated over a fixed number of centroid bins per axis. Only bounds go in; the resulting tree
+/// refers to primitives through primitiveOrder(), which lists primitive indices so that every leaf
+/// covers a contiguous range.
+/// </summary>
+class BvhBuilder
+{
+public:
+	struct Node
+	{
+		Aabb bounds;
+		std::unique_ptr<Node> children[2];
+		int axis = 0;
+		int firstPrim = 0; // leaves only, range into primitiveOrder()
+		int primCount = 0;
+
+		bool isLeaf() const { return primCount > 0; }
+	};
+
+	static constexpr int BinCount = 16;
+	// cost of visiting an interior node relative to intersecting one primitive
+	static constexpr double TraversalCost = 0.5;
+	// deeper than this, splits fall back to the centroid median so the tree stays within the
+	// fixed traversal stack of LinearBvh even on pathological inputs
+	static constexpr int MaxSahDepth = 32;
+
+	// baseDepth is the depth of the root when the result goes below an existing node
+	BvhBuilder(const std::vector<Aabb>& primBounds, int maxLeafPrims = 4, int baseDepth = 0) : maxLeafPrims(maxLeafPrims)
+	{
+		prims.reserve(primBounds.size());
+
+		for (int i = 0; i < (int)primBounds.size(); i++)
+			prims.push_back({ primBounds[i], primBounds[i].centroid(), i });
+
+		order.reserve(prims.size());
+
+		if (!prims.empty())
+			root = build(0, (int)prims.size(), baseDepth);
+	}
+
+	std::unique_ptr<Node> takeRoot() { return std::move(root); }
+	const std::vector<int>& primitiveOrder() const { return order; }
+	int nodeCount() const { return nodes; }
+
+private:
+	struct PrimInfo
+	{
+		Aabb bounds;
+		Point centroid;
+		int index;
+	};
+
+	struct Bin
+	{
+		Aabb bounds;
+		int count = 0;
+	};
+
+	std::vector<PrimInfo> prims;
+	std::vector<int> order;
+	std::unique_ptr<Node> root;
+	int maxLeafPrims;
+	int nodes = 0;
+
+	static int binIndex(const Point& centroid, const Aabb& centroidBounds, int axis)
+	{
+		double extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+		int bin = (int)(BinCount * (centroid[axis] - centroidBounds.min[axis]) / extent);
+		return std::clamp(bin, 0, BinCount - 1);
+	}
+
+	std::unique_ptr<Node> makeLeaf(std::unique_ptr<Node> node, int begin, int end)
+	{
+		node->firstPrim = (int)order.size();
+		node->primCount = end - begin;
+
+		for (int i = begin; i < end; i++)
+			order.push_back(prims[i].index);
+
+		return node;
+	}
+
+	std::unique_ptr<Node> build(int begin, int end, int depth)
+	{
+		auto node = std::make_unique<Node>();
+		nodes++;
+
+		Aabb centroidBounds;
+		for (int i = begin; i < end; i++)
+		{
+			node->bounds.grow(prims[i].bounds);
+			centroidBounds.grow(prims[i].centroid);
+		}
+
+		int count = end - begin;
+		if (count == 1)
+			return makeLeaf(std::move(node), begin, end);
+
+		// sweep the bins of every axis for the cheapest split plane
+		double bestCost = std::numeric_limits<double>::max();
+		int bestAxis = -1;
+		int bestBin = 0;
+
+		for (int axis = 0; axis < 3 && depth < MaxSahDepth; axis++)
+		{
+			if (centroidBounds.max[axis] - centroidBounds.min[axis] <= 0)
+				continue;
+
+			Bin bins[BinCount];
+			for (int i = begin; i < end; i++)
+			{
+				auto& bin = bins[binIndex(prims[i].centroid, centroidBounds, axis)];
+				bin.count++;
+				bin.bounds.grow(prims[i].bounds);
+			}
+
+			double leftArea[BinCount - 1];
+			int leftCount[BinCount - 1];
+			Aabb sweep;
+			int sweepCount = 0;
+
+			for (int i = 0; i < BinCount - 1; i++)
+			{
+				sweep.grow(bins[i].bounds);
+				sweepCount += bins[i].count;
+				leftArea[i] = sweep.surfaceArea();
+				leftCount[i] = sweepCount;
+			}
+
+			sweep = Aabb();
+			sweepCount = 0;
+
+			for (int i = BinCount - 1; i > 0; i--)
+			{
+				sweep.grow(bins[i].bounds);
+				sweepCount += bins[i].count;
+
+				double cost = leftCount[i - 1] * leftArea[i - 1] + sweepCount * sweep.surfaceArea();
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+
+		double area = node->bounds.surfaceArea();
+		double splitCost = (bestAxis >= 0 && area > 0) ? TraversalCost + bestCost / area : std::numeric_limits<double>::max();
+
+		if (count <= maxLeafPrims && splitCost >= count)
+			return makeLeaf(std::move(node), begin, end);
+
+		int mid = begin + count / 2;
+
+		if (bestAxis >= 0)
+		{
+			auto split = std::partition(prims.begin() + begin, prims.begin() + end, [&](const PrimInfo& prim)
+			{
+				return binIndex(prim.centroid, centroidBounds, bestAxis) < bestBin;
+			});
+			mid = (int)(split - prims.begin());
+			node->axis = bestAxis;
+		}
+		else
+		{
+			node->axis = centroidBounds.longestAxis();
+			std::nth_element(prims.begin() + begin, prims.begin() + mid, prims.begin() + end,
+				[&](const PrimInfo& a, const PrimInfo& b) { return a.centroid[node->axis] < b.centroid[node->axis]; });
+		}
+
+		// coincident centroids leave nothing to separate on, so just halve the range
+		if (mid == begin || mid == end)
+			mid = begin + count / 2;
+
+		node->children[0] = build(begin, mid, depth + 1);
+		node->children[1] = build(mid, end, depth + 1);
+		return node;
+	}
+};
+
+/// <summary>
+/// 32-byte BVH node. Bounds are stored in float, rounded outward so they never shrink.
+/// Interior nodes are followed directly by their first child; offset holds the index of the second.
+/// Leaves hold primCount > 0 primitives starting at offset.
+/// </summary>
+struct alignas(32) BvhNode
+{
+	float min[3];
+	float max[3];
+	uint32_t offset;
+	uint16_t primCount;
+	uint8_t axis;
+	uint8_t pad;
+
+	bool hit(const Ray& ray, const Vec& invDir, double tMin, double tMax) const
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			double t0 = (min[axis] - ray.origin()[axis]) * invDir[axis];
+			double t1 = (max[axis] - ray.origin()[axis]) * invDir[axis];
+
+			if (invDir[axis] < 0)
+				std::swap(t0, t1);
+
+			tMin = t0 > tMin ? t0 : tMin;
+			tMax = t1 < tMax ? t1 : tMax;
+
+			if (tMax < tMin)
+				return false;
+		}
+		return true;
+	}
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode should fill half a cache line");
+
+/// <summary>
+/// BVH flattened into one contiguous array of BvhNodes in depth-first order. It only knows about
+/// primitive bounds; callers reorder their primitives by primitiveOrder() so that leaf ranges index
+/// them directly, and supply the primitive intersection to traverse().
+/// </summary>
+class LinearBvh
+{
+public:
+	static constexpr int StackSize = 64;
+
+	LinearBvh() = default;
+
+	explicit LinearBvh(const std::vector<Aabb>& primBounds, int maxLeafPrims = 4, int baseDepth = 0)
+		: maxLeafPrims(maxLeafPrims)
+	{
+		BvhBuilder builder(primBounds, maxLeafPrims, baseDepth);
+		order = builder.primitiveOrder();
+
+		auto root = builder.takeRoot();
+		if (!root)
+			return;
+
+		nodes.reserve(builder.nodeCount());
+		flatten(root.get());
+	}
+
+	/// <summary>
+	/// Traverses count nodes flattened earlier and stored elsewhere, typically in a mapped scene
+	/// cache, without copying them. order is the primitiveOrder() they were built with, stored
+	/// alongside. owner keeps the node memory alive.
+	/// </summary>
+	LinearBvh(const BvhNode* nodes, int count, std::vector<int> order, std::shared_ptr<const void> owner)
+		: order(std::move(order)), external(nodes), externalCount(count), owner(std::move(owner))
+	{
+	}
+
+	/// <summary>
+	/// Stack-based closest-hit traversal, visiting the child on the near side of the split first.
+	/// intersectPrim(primIndex, tMin, closestHit) tests one primitive, shrinks closestHit on a hit
+	/// and returns whether it hit.
+	/// </summary>
+	template <typename IntersectFn>
+	bool traverse(const Ray& ray, double tMin, double& closestHit, IntersectFn&& intersectPrim, long long& visits) const
+	{
+		if (nodeCount() == 0)
+			return false;
+
+		const BvhNode* nodes = nodeData();
+		Vec invDir = 1.0 / ray.dir();
+		bool dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+		int stack[StackSize];
+		int stackSize = 0;
+		int current = 0;
+		bool hitValid = false;
+
+		while (true)
+		{
+			const BvhNode& node = nodes[current];
+			visits++;
+
+			if (node.hit(ray, invDir, tMin, closestHit))
+			{
+				if (node.primCount > 0)
+				{
+					for (uint32_t i = node.offset; i < node.offset + node.primCount; i++)
+					{
+						if (intersectPrim(i, tMin, closestHit))
+							hitValid = true;
+					}
+				}
+				else if (dirIsNeg[node.axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.offset;
+					continue;
+				}
+				else
+				{
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+		}
+		return hitValid;
+	}
+
+	/// <summary>
+	/// Any-hit traversal for visibility queries: returns as soon as occludedPrim(primIndex) reports
+	/// a hit. Near children still go first, blockers tend to sit close to the shading point.
+	/// </summary>
+	template <typename OccludedFn>
+	bool traverseAny(const Ray& ray, double tMin, double tMax, OccludedFn&& occludedPrim, long long& visits) const
+	{
+		if (nodeCount() == 0)
+			return false;
+
+		const BvhNode* nodes = nodeData();
+		Vec invDir = 1.0 / ray.dir();
+		bool dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+
+		int stack[StackSize];
+		int stackSize = 0;
+		int current = 0;
+
+		while (true)
+		{
+			const BvhNode& node = nodes[current];
+			visits++;
+
+			if (node.hit(ray, invDir, tMin, tMax))
+			{
+				if (node.primCount > 0)
+				{
+					for (uint32_t i = node.offset; i < node.offset + node.primCount; i++)
+					{
+						if (occludedPrim(i))
+							return true;
+					}
+				}
+				else if (dirIsNeg[node.axis])
+				{
+					stack[stackSize++] = current + 1;
+					current = node.offset;
+					continue;
+				}
+				else
+				{
+					stack[stackSize++] = node.offset;
+					current = current + 1;
+					continue;
+				}
+			}
+
+			if (stackSize == 0)
+				break;
+			current = stack[--stackSize];
+		}
+		return false;
+	}
+
+	Aabb bounds() const
+	{
+		return nodeCount() == 0 ? Aabb() : nodeBounds(0);
+	}
+
+	/// <summary>
+	/// Recomputes every node's bounds from leafBounds (indexed like leaf ranges, i.e. in primitive
+	/// order) after primitives moved, keeping the topology. Children come after their parent in
+	/// the array, so a single backward sweep sees both children before the parent.
+	/// </summary>
+	void refit(const std::vector<Aabb>& leafBounds)
+	{
+		makeOwned();
+
+		for (int i = (int)nodes.size() - 1; i >= 0; i--)
+		{
+			BvhNode& node = nodes[i];
+			Aabb box;
+
+			if (node.primCount > 0)
+			{
+				for (uint32_t prim = node.offset; prim < node.offset + node.primCount; prim++)
+					box.grow(leafBounds[prim]);
+			}
+			else
+			{
+				box = nodeBounds(i + 1);
+				box.grow(nodeBounds(node.offset));
+			}
+
+			setBounds(node, box);
+		}
+	}
+
+	/// <summary>
+	/// SAH cost of every subtree, unnormalized: surface area times TraversalCost summed over
+	/// interior nodes plus surface area times primitive count over leaves. Divided by a node's
+	/// own area it is the expected cost of a ray that enters that node.
+	/// </summary>
+	std::vector<double> subtreeCosts() const
+	{
+		const BvhNode* nodes = nodeData();
+		std::vector<double> costs(nodeCount());
+
+		for (int i = nodeCount() - 1; i >= 0; i--)
+		{
+			double area = nodeBounds(i).surfaceArea();
+
+			if (nodes[i].primCount > 0)
+				costs[i] = area * nodes[i].primCount;
+			else
+				costs[i] = area * BvhBuilder::TraversalCost + costs[i + 1] + costs[nodes[i].offset];
+		}
+		return costs;
+	}
+
+	// nodes of the subtree at index are [index, subtreeEnd(index)), its rightmost node is last
+	int subtreeEnd(int index) const
+	{
+		const BvhNode* nodes = nodeData();
+		while (nodes[index].primCount == 0)
+			index = nodes[index].offset;
+		return index + 1;
+	}
+
+	// primitives of the subtree at index are the range [first, first + count) of leaf order
+	void subtreePrimitives(int index, int& first, int& count) const
+	{
+		const BvhNode* nodes = nodeData();
+
+		int leftmost = index;
+		while (nodes[leftmost].primCount == 0)
+			leftmost++;
+
+		const BvhNode& rightmost = nodes[subtreeEnd(index) - 1];
+		first = nodes[leftmost].offset;
+		count = rightmost.offset + rightmost.primCount - first;
+	}
+
+	/// <summary>
+	/// Builds the subtree at index (depth levels below the root) again from scratch over the
+	/// current bounds of its primitives and splices it in place of the old one; node indices after
+	/// it shift by the change in size. The primitives stay within their range of leaf order but
+	/// may be permuted: the returned vector lists, for every new position in the range, the old
+	/// position relative to first, and callers must reorder their primitives to match.
+	/// </summary>
+	std::vector<int> rebuildSubtree(int index, int depth, const std::vector<Aabb>& leafBounds)
+	{
+		makeOwned();
+
+		int first, count;
+		subtreePrimitives(index, first, count);
+		int end = subtreeEnd(index);
+
+		LinearBvh sub(std::vector<Aabb>(leafBounds.begin() + first, leafBounds.begin() + first + count), maxLeafPrims, depth);
+		int delta = sub.nodeCount() - (end - index);
+
+		// second-child links past the old subtree move with the nodes they point to
+		for (int i = 0; i < (int)nodes.size(); i++)
+		{
+			if ((i < index || i >= end) && nodes[i].primCount == 0 && (int)nodes[i].offset >= end)
+				nodes[i].offset += delta;
+		}
+
+		for (auto& node : sub.nodes)
+			node.offset += node.primCount > 0 ? first : index;
+
+		nodes.erase(nodes.begin() + index, nodes.begin() + end);
+		nodes.insert(nodes.begin() + index, sub.nodes.begin(), sub.nodes.end());
+
+		if (!order.empty())
+		{
+			std::vector<int> old(order.begin() + first, order.begin() + first + count);
+			for (int i = 0; i < count; i++)
+				order[first + i] = old[sub.order[i]];
+		}
+
+		return sub.order;
+	}
+
+	Aabb nodeBounds(int index) const
+	{
+		const BvhNode& node = nodeData()[index];
+		return Aabb(Point(node.min[0], node.min[1], node.min[2]), Point(node.max[0], node.max[1], node.max[2]));
+	}
+
+	const std::vector<int>& primitiveOrder() const { return order; }
+	int nodeCount() const { return external ? externalCount : (int)nodes.size(); }
+	const BvhNode* nodeData() const { return external ? external : nodes.data(); }
+
+private:
+	std::vector<BvhNode> nodes;
+	std::vector<int> order;
+	int maxLeafPrims = 4; // what rebuilt subtrees use
+	const BvhNode* external = nullptr; // set instead of nodes when traversing someone else's memory
+	int externalCount = 0;
+	std::shared_ptr<const void> owner;
+
+	// refitting writes to the nodes, so stop sharing mapped ones and take a copy first
+	void makeOwned()
+	{
+		if (!external)
+			return;
+
+		nodes.assign(external, external + externalCount);
+		external = nullptr;
+		externalCount = 0;
+		owner.reset();
+	}
+
+	static void setBounds(BvhNode& node, const Aabb& box)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.min[axis] = roundDown(box.min[axis]);
+			node.max[axis] = roundUp(box.max[axis]);
+		}
+	}
+
+	static float roundDown(double value)
+	{
+		float f = (float)value;
+		return f > value ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static float roundUp(double value)
+	{
+		float f = (float)value;
+		return f < value ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+	}
+
+	int flatten(const BvhBuilder::Node* node)
+	{
+		int index = (int)nodes.size();
+		nodes.emplace_back();
+
+		BvhNode flat{};
+		setBounds(flat, node->bounds);
+
+		if (node->isLeaf())
+		{
+			flat.offset = node->firstPrim;
+			flat.primCount = (uint16_t)node->primCount;
+		}
+		else
+		{
+			flat.axis = (uint8_t)node->axis;
+			flatten(node->children[0].get());
+			flat.offset = flatten(node->children[1].get());
+		}
+
+		nodes[index] = flat;
+		return index;
+	}
+};
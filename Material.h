@@ -1,8 +1,9 @@
 #pragma once
-#include <random>
+#include <variant>
+#include <vector>
 #include "Hittable.h"
 #include "Color.h"
-#include "Random.h"
+#include "Sampler.h"
 #include "Pdf.h"
 
 // for the sake of speed, avoid polymoprhism
@@ -11,37 +12,34 @@ class ScatterRecord
 public:
 	bool scattered;
 	Color attenuation;
-	std::shared_ptr<Pdf> pdfPtr;
+	ScatterPdf pdf; // held by value, scattering must not touch the heap
 	bool skipPdf;
 	Ray skipPdfRay;
 
-	ScatterRecord(bool scattered, const Color& attenuation, const std::shared_ptr<Pdf>& pdfPtr, bool skipPdf, const Ray& skipPdfRay)
-		: scattered(scattered), attenuation(attenuation), pdfPtr(pdfPtr), skipPdf(skipPdf), skipPdfRay(skipPdfRay)
+	ScatterRecord(bool scattered, const Color& attenuation, const ScatterPdf& pdf, bool skipPdf, const Ray& skipPdfRay)
+		: scattered(scattered), attenuation(attenuation), pdf(pdf), skipPdf(skipPdf), skipPdfRay(skipPdfRay)
 	{
 	}
 };
 
-// Handles the attenuation and scatter pdf values. The importance sampling is done elsewhere.
-class Material
+// Shared default for the closed set of materials below: nothing emits unless it says so.
+// Not a polymorphic base, dispatch happens through Material's type tag.
+class MaterialBase
 {
 public:
-	virtual ~Material() = default;
-	/// <summary>
-	/// rayIn is the ray from the camera, but actually the outgoing ray physically. 
-	/// Using the design choice to always scatter with attenuation, instead of scattering 
-	/// probabilistically to model the albedo.
-	/// This function tells if the ray scatters, what is the attentuation in the rendering equation,
-	/// what is the unbiased pdf to scatter with, or provides a scattering direction in the case of Dirac distribution.
-	/// </summary>
-	virtual ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Random& rand) = 0;
+	// radiance given off by an emitting surface, independent of direction
+	Color emission() const
+	{
+		return Color(0, 0, 0);
+	}
 
-	virtual Color emitted(const Ray& rayIn, const Hit& hit, Random& rand)
+	Color emitted(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
 	{
 		return Color(0, 0, 0);
 	}
 };
 
-class Lambertian : public Material
+class Lambertian : public MaterialBase
 {
 private:
 	Color albedo;
@@ -49,17 +47,17 @@ public:
 	Lambertian(const Color& albedo_)
 		: albedo(albedo_) {}
 
-	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Random& rand) override
+	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
 	{
-		return ScatterRecord(true, albedo, std::make_shared<CosinePdf>(hit.normal), false, Ray());
+		return ScatterRecord(true, albedo, CosinePdf(hit.normal), false, Ray());
 	}
 
 	/// <summary>
 	/// Returns a normalized scatter direction.
 	/// </summary>
-	Vec sampleLambertian(const Vec& normal, Random& rand)
+	Vec sampleLambertian(const Vec& normal, Sampler& sampler)
 	{
-		Vec vec = rand.sampleUnitSphere();
+		Vec vec = sampler.sampleUnitSphere();
 		
 		vec = vec + normal;
 
@@ -72,7 +70,7 @@ public:
 	}
 };
 
-class Metal : public Material
+class Metal : public MaterialBase
 {
 public:
 	Metal(const Color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz)
@@ -83,32 +81,30 @@ public:
 		}
 	}
 
-	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Random& rand) override
+	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
 	{
 		// normal is unit vector, so is incident ray
 		auto rayDir = rayIn.dir() - 2 * glm::dot(hit.normal, rayIn.dir()) * hit.normal;
 
-		Vec vec = rand.sampleUnitSphere();
+		Vec vec = sampler.sampleUnitSphere();
 		rayDir = glm::normalize(rayDir) + fuzz * vec;
 
-		return ScatterRecord(true, albedo, nullptr, true, Ray(hit.pos, rayDir));
+		return ScatterRecord(true, albedo, ScatterPdf(), true, Ray(hit.pos, rayDir));
 	}
 private:
 	Color albedo;
 	double fuzz;
-	std::uniform_real_distribution<double> distribution;
-	std::shared_ptr<std::mt19937> generator;
 };
 
 
-class Dielectric : public Material
+class Dielectric : public MaterialBase
 {
 public:
 	Dielectric(double refractionIndex) : refractionIndex(refractionIndex)
 	{
 	}
 
-	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Random& rand) override
+	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
 	{
 		// frontface: ray is hitting material from outside
 		double ri = hit.frontface ? 1.0 / refractionIndex : refractionIndex;
@@ -119,7 +115,7 @@ public:
 
 		Ray rayOut;
 		// apply Schlick approximation stochastically (no way to do linear combination)
-		if (ri * sinTheta > 1.0 || reflectance(cosTheta, ri) > rand.randomDouble())
+		if (ri * sinTheta > 1.0 || reflectance(cosTheta, ri) > sampler.get1D())
 		{
 			// reflection
 			rayOut = Ray(hit.pos, reflect(rayIn.dir(), hit.normal));
@@ -129,7 +125,7 @@ public:
 			rayOut = Ray(hit.pos, refract(rayIn.dir(), hit.normal, ri));
 		}
 
-		return ScatterRecord(true, Color(1, 1, 1), nullptr, true, rayOut);
+		return ScatterRecord(true, Color(1, 1, 1), ScatterPdf(), true, rayOut);
 	}
 private:
 	double refractionIndex; // ratio of material index over enclosing media index
@@ -142,7 +138,7 @@ private:
 	}
 };
 
-class Emissive : public Material
+class Emissive : public MaterialBase
 {
 private:
 	Color color;
@@ -151,14 +147,90 @@ public:
 	{
 
 	}
-	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Random& rand) override
+	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
 	{
-		return ScatterRecord(false, Color(), nullptr, false, Ray());
+		return ScatterRecord(false, Color(), ScatterPdf(), false, Ray());
 	}
-	Color emitted(const Ray& rayIn, const Hit& hit, Random& rand) override
+	Color emitted(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
 	{
 		if (!hit.frontface)
 			return Color(0, 0, 0);
 		return color;
 	}
+	Color emission() const
+	{
+		return color;
+	}
+};
+
+// Handles the attenuation and scatter pdf values. The importance sampling is done elsewhere.
+// A closed set of materials dispatched on the variant's type tag, so scatter and emitted
+// can be inlined into the integrator instead of going through a vtable.
+class Material
+{
+public:
+	template <typename T>
+	Material(const T& material) : material(material)
+	{
+	}
+
+	/// <summary>
+	/// rayIn is the ray from the camera, but actually the outgoing ray physically. 
+	/// Using the design choice to always scatter with attenuation, instead of scattering 
+	/// probabilistically to model the albedo.
+	/// This function tells if the ray scatters, what is the attentuation in the rendering equation,
+	/// what is the unbiased pdf to scatter with, or provides a scattering direction in the case of Dirac distribution.
+	/// </summary>
+	ScatterRecord scatter(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
+	{
+		return std::visit([&](const auto& m) { return m.scatter(rayIn, hit, sampler); }, material);
+	}
+
+	Color emitted(const Ray& rayIn, const Hit& hit, Sampler& sampler) const
+	{
+		return std::visit([&](const auto& m) { return m.emitted(rayIn, hit, sampler); }, material);
+	}
+
+	Color emission() const
+	{
+		return std::visit([](const auto& m) { return m.emission(); }, material);
+	}
+
+private:
+	std::variant<Lambertian, Metal, Dielectric, Emissive> material;
+};
+
+// Contiguous storage for every material in a scene. Hittables refer to materials by index.
+class MaterialTable
+{
+public:
+	MaterialTable() = default;
+
+	MaterialTable(const Material* first, size_t count) : materials(first, first + count)
+	{
+	}
+
+	MaterialId add(const Material& material)
+	{
+		materials.push_back(material);
+		return (MaterialId)(materials.size() - 1);
+	}
+
+	const Material& operator[](MaterialId id) const
+	{
+		return materials[id];
+	}
+
+	size_t size() const
+	{
+		return materials.size();
+	}
+
+	const Material* data() const
+	{
+		return materials.data();
+	}
+
+private:
+	std::vector<Material> materials;
 };
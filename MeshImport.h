@@ -0,0 +1,841 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Material.h"
+#include "ThreadPool.h"
+
+// Arrays for a TriangleMesh, filled in place by the importers below.
+struct MeshData
+{
+	std::vector<Point> positions;
+	std::vector<Vec> normals; // empty, or one per position
+	std::vector<uint32_t> indices;
+	std::vector<MaterialId> triangleMaterials; // empty when the file assigns no materials
+};
+
+namespace meshimport_detail
+{
+	constexpr size_t ChunkBytes = 1 << 22; // OBJ text per parse task
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	// Cursor over one line of text, tokens separated by spaces or tabs.
+	struct LineReader
+	{
+		const char* p;
+		const char* end;
+
+		void skipSpace()
+		{
+			while (p < end && isSpace(*p))
+				p++;
+		}
+
+		std::string_view word()
+		{
+			skipSpace();
+			const char* begin = p;
+			while (p < end && !isSpace(*p))
+				p++;
+			return std::string_view(begin, p - begin);
+		}
+
+		bool number(double& value)
+		{
+			skipSpace();
+			auto result = std::from_chars(p, end, value);
+			if (result.ec != std::errc())
+				return false;
+			p = result.ptr;
+			return true;
+		}
+
+		// the rest of the line, trimmed, for names that may contain spaces
+		std::string_view rest()
+		{
+			skipSpace();
+			const char* last = end;
+			while (last > p && isSpace(last[-1]))
+				last--;
+			return std::string_view(p, last - p);
+		}
+	};
+
+	// [begin, end) of the text split into about ChunkBytes pieces, each ending after a newline
+	inline std::vector<const char*> splitLines(const char* begin, const char* end)
+	{
+		std::vector<const char*> bounds{ begin };
+		const char* p = begin;
+
+		while (end - p > (ptrdiff_t)ChunkBytes)
+		{
+			const char* cut = static_cast<const char*>(std::memchr(p + ChunkBytes, '\n', end - (p + ChunkBytes)));
+			if (!cut)
+				break;
+			p = cut + 1;
+			bounds.push_back(p);
+		}
+
+		bounds.push_back(end);
+		return bounds;
+	}
+
+	/// <summary>
+	/// Reads an MTL library into materials, mapping each entry onto the closest of the four material
+	/// types: emissive if Ke is set, dielectric if transparent (d < 1, Tr > 0 or a glass illum model),
+	/// metal if specular dominates or illum asks for reflection (fuzz from the Phong exponent),
+	/// Lambertian otherwise.
+	/// </summary>
+	inline void readMtl(const std::string& path, MaterialTable& materials, std::unordered_map<std::string, MaterialId>& ids)
+	{
+		MappedFile file(path);
+		if (!file.valid())
+		{
+			std::cout << "Cannot open material library " << path << ", using the default material" << std::endl;
+			return;
+		}
+
+		struct Entry
+		{
+			std::string name;
+			Color kd = Color(0.8, 0.8, 0.8);
+			Color ks = Color(0, 0, 0);
+			Color ke = Color(0, 0, 0);
+			double ni = 1.5;
+			double dissolve = 1;
+			double ns = 0;
+			int illum = 2;
+		};
+
+		std::vector<Entry> entries;
+		const char* p = file.data();
+		const char* end = p + file.size();
+
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+
+			LineReader line{ p, lineEnd };
+			p = lineEnd + 1;
+
+			std::string_view key = line.word();
+			if (key == "newmtl")
+			{
+				entries.push_back(Entry());
+				entries.back().name = std::string(line.rest());
+				continue;
+			}
+
+			if (entries.empty())
+				continue;
+
+			Entry& e = entries.back();
+			double x = 0, y = 0, z = 0;
+
+			if (key == "Kd" && line.number(x) && line.number(y) && line.number(z)) e.kd = Color(x, y, z);
+			else if (key == "Ks" && line.number(x) && line.number(y) && line.number(z)) e.ks = Color(x, y, z);
+			else if (key == "Ke" && line.number(x) && line.number(y) && line.number(z)) e.ke = Color(x, y, z);
+			else if (key == "Ni" && line.number(x)) e.ni = x;
+			else if (key == "d" && line.number(x)) e.dissolve = x;
+			else if (key == "Tr" && line.number(x)) e.dissolve = 1 - x;
+			else if (key == "Ns" && line.number(x)) e.ns = x;
+			else if (key == "illum" && line.number(x)) e.illum = (int)x;
+		}
+
+		for (auto& e : entries)
+		{
+			MaterialId id;
+
+			if (e.ke != Color(0, 0, 0))
+				id = materials.add(Emissive(e.ke));
+			else if (e.dissolve < 1 || e.illum == 4 || e.illum == 6 || e.illum == 7)
+				id = materials.add(Dielectric(e.ni > 1 ? e.ni : 1.5));
+			else if (e.illum == 3 || e.illum == 5 || luminance(e.ks) > luminance(e.kd))
+				id = materials.add(Metal(e.ks, std::clamp(std::sqrt(2 / (e.ns + 2)), 0.0, 1.0)));
+			else
+				id = materials.add(Lambertian(e.kd));
+
+			ids[e.name] = id;
+		}
+	}
+
+	struct ObjChunk
+	{
+		// first pass
+		size_t vertices = 0, normals = 0, triangles = 0, lines = 0;
+		bool hasUsemtl = false;
+		std::string lastMaterial; // name of the chunk's last usemtl
+		std::vector<std::string> libraries;
+
+		// second pass
+		size_t vertexBase = 0, normalBase = 0, triangleBase = 0, lineBase = 0;
+		MaterialId startMaterial = 0;
+		bool normalsMatch = true; // every corner's normal index equals its position index
+		std::string error;
+	};
+
+	// one corner of an OBJ face: v, v/vt, v//vn or v/vt/vn
+	inline bool parseCorner(std::string_view token, long long& v, long long& vn, bool& hasNormal)
+	{
+		const char* p = token.data();
+		const char* end = p + token.size();
+
+		auto result = std::from_chars(p, end, v);
+		if (result.ec != std::errc())
+			return false;
+		p = result.ptr;
+		hasNormal = false;
+
+		if (p < end && *p == '/')
+		{
+			p++;
+			while (p < end && *p != '/')
+				p++; // texture coordinates are not used
+
+			if (p < end && *p == '/')
+			{
+				result = std::from_chars(p + 1, end, vn);
+				hasNormal = result.ec == std::errc();
+			}
+		}
+		return true;
+	}
+
+	// 1-based or negative (relative to the end so far) OBJ index to a 0-based one, -1 if invalid
+	inline long long resolveIndex(long long index, size_t countSoFar)
+	{
+		if (index > 0)
+			return index - 1;
+		if (index < 0)
+			return (long long)countSoFar + index;
+		return -1;
+	}
+
+	template <typename T>
+	T readScalar(const char* p, bool swap)
+	{
+		char bytes[sizeof(T)];
+		std::memcpy(bytes, p, sizeof(T));
+		if (swap)
+			std::reverse(bytes, bytes + sizeof(T));
+
+		T value;
+		std::memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+	inline bool plyType(std::string_view name, PlyType& type)
+	{
+		if (name == "char" || name == "int8") type = PlyType::Int8;
+		else if (name == "uchar" || name == "uint8") type = PlyType::UInt8;
+		else if (name == "short" || name == "int16") type = PlyType::Int16;
+		else if (name == "ushort" || name == "uint16") type = PlyType::UInt16;
+		else if (name == "int" || name == "int32") type = PlyType::Int32;
+		else if (name == "uint" || name == "uint32") type = PlyType::UInt32;
+		else if (name == "float" || name == "float32") type = PlyType::Float32;
+		else if (name == "double" || name == "float64") type = PlyType::Float64;
+		else return false;
+		return true;
+	}
+
+	inline size_t plySize(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: case PlyType::UInt8: return 1;
+		case PlyType::Int16: case PlyType::UInt16: return 2;
+		case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+		default: return 8;
+		}
+	}
+
+	inline double plyRead(const char* p, PlyType type, bool swap)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: return (int8_t)*p;
+		case PlyType::UInt8: return (uint8_t)*p;
+		case PlyType::Int16: return readScalar<int16_t>(p, swap);
+		case PlyType::UInt16: return readScalar<uint16_t>(p, swap);
+		case PlyType::Int32: return readScalar<int32_t>(p, swap);
+		case PlyType::UInt32: return readScalar<uint32_t>(p, swap);
+		case PlyType::Float32: return readScalar<float>(p, swap);
+		default: return readScalar<double>(p, swap);
+		}
+	}
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type;
+		bool isList = false;
+		PlyType countType = PlyType::UInt8; // lists only
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count = 0;
+		std::vector<PlyProperty> properties;
+
+		bool fixedSize() const
+		{
+			return std::none_of(properties.begin(), properties.end(), [](const PlyProperty& p) { return p.isList; });
+		}
+
+		size_t stride() const
+		{
+			size_t size = 0;
+			for (auto& p : properties)
+				size += plySize(p.type);
+			return size;
+		}
+	};
+
+	// bytes taken by one record of an element with list properties starting at p, 0 if it runs past end
+	inline size_t plyRecordSize(const PlyElement& element, const char* p, const char* end, bool swap)
+	{
+		size_t size = 0;
+		for (auto& prop : element.properties)
+		{
+			if (prop.isList)
+			{
+				size_t countSize = plySize(prop.countType);
+				if (end - p < (ptrdiff_t)(size + countSize))
+					return 0;
+				double count = plyRead(p + size, prop.countType, swap);
+				size += countSize + (size_t)count * plySize(prop.type);
+			}
+			else
+			{
+				size += plySize(prop.type);
+			}
+		}
+		return end - p < (ptrdiff_t)size ? 0 : size;
+	}
+}
+
+/// <summary>
+/// Wavefront OBJ: v, vn, f (polygons fanned into triangles, negative indices allowed), mtllib and
+/// usemtl. The mapped text is cut into line-aligned chunks that are parsed in parallel twice: once
+/// to count, and after a prefix sum over the counts once more to write every vertex, normal and
+/// index straight to its final place. Normals are kept only when every corner uses its position's
+/// index for the normal too, as TriangleMesh has one normal per vertex. Faces before any usemtl,
+/// or naming an unknown material, get defaultMat.
+/// </summary>
+inline MeshData loadObj(const std::string& path, MaterialTable& materials, MaterialId defaultMat, int threads = 0)
+{
+	using namespace meshimport_detail;
+
+	MappedFile file(path);
+	if (!file.valid())
+		throw std::runtime_error("Cannot open mesh " + path);
+
+	auto bounds = splitLines(file.data(), file.data() + file.size());
+	int chunkCount = (int)bounds.size() - 1;
+	std::vector<ObjChunk> chunks(chunkCount);
+	ThreadPool pool(threads);
+
+	pool.parallelFor(chunkCount, [&](int c, int)
+	{
+		ObjChunk& chunk = chunks[c];
+		const char* p = bounds[c];
+		const char* end = bounds[c + 1];
+
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+
+			LineReader line{ p, lineEnd };
+			p = lineEnd + 1;
+			chunk.lines++;
+
+			std::string_view key = line.word();
+			if (key == "v")
+			{
+				chunk.vertices++;
+			}
+			else if (key == "vn")
+			{
+				chunk.normals++;
+			}
+			else if (key == "f")
+			{
+				int corners = 0;
+				while (!line.word().empty())
+					corners++;
+				if (corners >= 3)
+					chunk.triangles += corners - 2;
+			}
+			else if (key == "usemtl")
+			{
+				chunk.hasUsemtl = true;
+				chunk.lastMaterial = std::string(line.rest());
+			}
+			else if (key == "mtllib")
+			{
+				chunk.libraries.push_back(std::string(line.rest()));
+			}
+		}
+	});
+
+	std::unordered_map<std::string, MaterialId> materialIds;
+	auto directory = std::filesystem::path(path).parent_path();
+
+	size_t vertexCount = 0, normalCount = 0, triangleCount = 0, lineCount = 0;
+	bool anyUsemtl = false;
+	MaterialId current = defaultMat;
+
+	for (auto& chunk : chunks)
+	{
+		for (auto& library : chunk.libraries)
+			readMtl((directory / library).string(), materials, materialIds);
+	}
+
+	auto lookup = [&](const std::string& name)
+	{
+		auto it = materialIds.find(name);
+		return it != materialIds.end() ? it->second : defaultMat;
+	};
+
+	for (auto& chunk : chunks)
+	{
+		chunk.vertexBase = vertexCount;
+		chunk.normalBase = normalCount;
+		chunk.triangleBase = triangleCount;
+		chunk.lineBase = lineCount;
+		chunk.startMaterial = current;
+
+		vertexCount += chunk.vertices;
+		normalCount += chunk.normals;
+		triangleCount += chunk.triangles;
+		lineCount += chunk.lines;
+
+		if (chunk.hasUsemtl)
+		{
+			anyUsemtl = true;
+			current = lookup(chunk.lastMaterial);
+		}
+	}
+
+	if (vertexCount > UINT32_MAX || triangleCount > UINT32_MAX / 3)
+		throw std::runtime_error(path + ": too large for 32-bit indices");
+
+	MeshData mesh;
+	mesh.positions.resize(vertexCount);
+	mesh.normals.resize(normalCount);
+	mesh.indices.resize(3 * triangleCount);
+	if (anyUsemtl)
+		mesh.triangleMaterials.resize(triangleCount);
+
+	pool.parallelFor(chunkCount, [&](int c, int)
+	{
+		ObjChunk& chunk = chunks[c];
+		const char* p = bounds[c];
+		const char* end = bounds[c + 1];
+
+		size_t v = chunk.vertexBase, vn = chunk.normalBase, tri = chunk.triangleBase, lineNumber = chunk.lineBase;
+		MaterialId mat = chunk.startMaterial;
+
+		auto fail = [&](const char* message)
+		{
+			if (chunk.error.empty())
+				chunk.error = path + ":" + std::to_string(lineNumber) + ": " + message;
+		};
+
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+
+			LineReader line{ p, lineEnd };
+			p = lineEnd + 1;
+			lineNumber++;
+
+			std::string_view key = line.word();
+			if (key == "v" || key == "vn")
+			{
+				double x, y, z;
+				if (!line.number(x) || !line.number(y) || !line.number(z))
+				{
+					fail("expected three coordinates");
+					x = y = z = 0;
+				}
+
+				if (key == "v")
+					mesh.positions[v++] = Point(x, y, z);
+				else
+					mesh.normals[vn++] = Vec(x, y, z);
+			}
+			else if (key == "f")
+			{
+				uint32_t first = 0, previous = 0;
+				int corner = 0;
+
+				for (std::string_view token = line.word(); !token.empty(); token = line.word(), corner++)
+				{
+					long long vi = 0, ni = 0;
+					bool hasNormal = false;
+					if (!parseCorner(token, vi, ni, hasNormal))
+					{
+						fail("bad face corner");
+						vi = 1;
+					}
+
+					long long index = resolveIndex(vi, v);
+					if (index < 0 || index >= (long long)vertexCount)
+					{
+						fail("face index out of range");
+						index = 0;
+					}
+
+					if (!hasNormal || resolveIndex(ni, vn) != index)
+						chunk.normalsMatch = false;
+
+					if (corner == 0)
+						first = (uint32_t)index;
+					else if (corner >= 2)
+					{
+						// fan around the first corner
+						mesh.indices[3 * tri] = first;
+						mesh.indices[3 * tri + 1] = previous;
+						mesh.indices[3 * tri + 2] = (uint32_t)index;
+						if (anyUsemtl)
+							mesh.triangleMaterials[tri] = mat;
+						tri++;
+					}
+					previous = (uint32_t)index;
+				}
+			}
+			else if (key == "usemtl")
+			{
+				mat = lookup(std::string(line.rest()));
+			}
+		}
+	});
+
+	bool normalsMatch = normalCount == vertexCount;
+	for (auto& chunk : chunks)
+	{
+		if (!chunk.error.empty())
+			throw std::runtime_error(chunk.error);
+		normalsMatch = normalsMatch && (chunk.normalsMatch || chunk.triangles == 0);
+	}
+
+	if (!normalsMatch)
+		mesh.normals.clear();
+
+	return mesh;
+}
+
+/// <summary>
+/// Binary PLY, either byte order: x, y, z and optional nx, ny, nz from the vertex element, and the
+/// vertex_indices list of the face element (polygons fanned into triangles). Vertices have a fixed
+/// stride and convert in parallel straight away. Faces are variable length, so one sequential hop
+/// over their counts marks where each chunk of faces starts, then the chunks decode in parallel.
+/// PLY has no materials, so the mesh's own material applies to every triangle.
+/// </summary>
+inline MeshData loadPly(const std::string& path, int threads = 0)
+{
+	using namespace meshimport_detail;
+
+	MappedFile file(path);
+	if (!file.valid())
+		throw std::runtime_error("Cannot open mesh " + path);
+
+	const char* data = file.data();
+	const char* end = data + file.size();
+
+	std::string_view text(data, file.size());
+	size_t headerEnd = text.find("end_header");
+	if (text.substr(0, 3) != "ply" || headerEnd == std::string_view::npos)
+		throw std::runtime_error(path + ": not a PLY file");
+
+	const char* body = static_cast<const char*>(std::memchr(data + headerEnd, '\n', file.size() - headerEnd));
+	if (!body)
+		throw std::runtime_error(path + ": truncated PLY header");
+	body++;
+
+	bool swap = false;
+	std::vector<PlyElement> elements;
+
+	const char* p = data;
+	while (p < data + headerEnd)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		LineReader line{ p, lineEnd };
+		p = lineEnd + 1;
+
+		std::string_view key = line.word();
+		if (key == "format")
+		{
+			std::string_view format = line.word();
+			if (format == "binary_big_endian")
+				swap = true;
+			else if (format != "binary_little_endian")
+				throw std::runtime_error(path + ": only binary PLY is supported");
+		}
+		else if (key == "element")
+		{
+			PlyElement element;
+			element.name = std::string(line.word());
+			double count = 0;
+			if (!line.number(count))
+				throw std::runtime_error(path + ": bad element count");
+			element.count = (size_t)count;
+			elements.push_back(element);
+		}
+		else if (key == "property" && !elements.empty())
+		{
+			PlyProperty prop;
+			std::string_view type = line.word();
+			bool ok;
+
+			if (type == "list")
+			{
+				prop.isList = true;
+				ok = plyType(line.word(), prop.countType) && plyType(line.word(), prop.type);
+			}
+			else
+			{
+				ok = plyType(type, prop.type);
+			}
+
+			if (!ok)
+				throw std::runtime_error(path + ": unknown PLY property type");
+			prop.name = std::string(line.word());
+			elements.back().properties.push_back(prop);
+		}
+	}
+
+	// little-endian hosts only have to swap big-endian files
+	uint16_t probe = 1;
+	bool littleHost = *reinterpret_cast<const uint8_t*>(&probe) == 1;
+	if (!littleHost)
+		swap = !swap;
+
+	MeshData mesh;
+	ThreadPool pool(threads);
+	const char* cursor = body;
+
+	for (auto& element : elements)
+	{
+		if (element.name == "vertex")
+		{
+			if (!element.fixedSize())
+				throw std::runtime_error(path + ": vertex element with list properties");
+
+			size_t stride = element.stride();
+			if ((size_t)(end - cursor) / std::max<size_t>(stride, 1) < element.count)
+				throw std::runtime_error(path + ": truncated vertex data");
+
+			int offsets[6] = { -1, -1, -1, -1, -1, -1 };
+			PlyType types[6] = {};
+			const char* names[6] = { "x", "y", "z", "nx", "ny", "nz" };
+			size_t offset = 0;
+
+			for (auto& prop : element.properties)
+			{
+				for (int i = 0; i < 6; i++)
+				{
+					if (prop.name == names[i])
+					{
+						offsets[i] = (int)offset;
+						types[i] = prop.type;
+					}
+				}
+				offset += plySize(prop.type);
+			}
+
+			if (offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0)
+				throw std::runtime_error(path + ": vertex element without x, y, z");
+
+			bool hasNormals = offsets[3] >= 0 && offsets[4] >= 0 && offsets[5] >= 0;
+			mesh.positions.resize(element.count);
+			if (hasNormals)
+				mesh.normals.resize(element.count);
+
+			const size_t perTask = 1 << 16;
+			const char* vertices = cursor;
+
+			pool.parallelFor((int)((element.count + perTask - 1) / perTask), [&](int task, int)
+			{
+				size_t last = std::min(element.count, (task + 1) * perTask);
+				for (size_t i = task * perTask; i < last; i++)
+				{
+					const char* record = vertices + i * stride;
+					mesh.positions[i] = Point(plyRead(record + offsets[0], types[0], swap),
+						plyRead(record + offsets[1], types[1], swap), plyRead(record + offsets[2], types[2], swap));
+
+					if (hasNormals)
+						mesh.normals[i] = Vec(plyRead(record + offsets[3], types[3], swap),
+							plyRead(record + offsets[4], types[4], swap), plyRead(record + offsets[5], types[5], swap));
+				}
+			});
+
+			cursor += element.count * stride;
+		}
+		else if (element.name == "face")
+		{
+			int listIndex = -1;
+			for (int i = 0; i < (int)element.properties.size(); i++)
+			{
+				auto& prop = element.properties[i];
+				if (prop.isList && (prop.name == "vertex_indices" || prop.name == "vertex_index"))
+					listIndex = i;
+			}
+
+			if (listIndex < 0)
+				throw std::runtime_error(path + ": face element without vertex_indices");
+
+			// sequential hop over the records: where each chunk starts and how many triangles precede it
+			const size_t perTask = 1 << 16;
+			size_t taskCount = (element.count + perTask - 1) / perTask;
+			std::vector<const char*> taskStart(taskCount);
+			std::vector<size_t> taskTriangles(taskCount + 1, 0);
+
+			size_t triangles = 0;
+			for (size_t i = 0; i < element.count; i++)
+			{
+				if (i % perTask == 0)
+				{
+					taskStart[i / perTask] = cursor;
+					taskTriangles[i / perTask] = triangles;
+				}
+
+				size_t size = plyRecordSize(element, cursor, end, swap);
+				if (size == 0)
+					throw std::runtime_error(path + ": truncated face data");
+
+				// offset of the index list within the record
+				const char* q = cursor;
+				for (int k = 0; k < listIndex; k++)
+				{
+					auto& prop = element.properties[k];
+					q += prop.isList ? plySize(prop.countType) + (size_t)plyRead(q, prop.countType, swap) * plySize(prop.type) : plySize(prop.type);
+				}
+
+				size_t corners = (size_t)plyRead(q, element.properties[listIndex].countType, swap);
+				if (corners >= 3)
+					triangles += corners - 2;
+				cursor += size;
+			}
+
+			if (triangles > UINT32_MAX / 3)
+				throw std::runtime_error(path + ": too large for 32-bit indices");
+
+			mesh.indices.resize(3 * triangles);
+
+			pool.parallelFor((int)taskCount, [&](int task, int)
+			{
+				const char* record = taskStart[task];
+				size_t tri = taskTriangles[task];
+				size_t last = std::min(element.count, (task + 1) * perTask);
+
+				for (size_t i = task * perTask; i < last; i++)
+				{
+					const char* q = record;
+					for (int k = 0; k < listIndex; k++)
+					{
+						auto& prop = element.properties[k];
+						q += prop.isList ? plySize(prop.countType) + (size_t)plyRead(q, prop.countType, swap) * plySize(prop.type) : plySize(prop.type);
+					}
+
+					auto& list = element.properties[listIndex];
+					size_t corners = (size_t)plyRead(q, list.countType, swap);
+					q += plySize(list.countType);
+					size_t indexSize = plySize(list.type);
+
+					uint32_t first = 0, previous = 0;
+					for (size_t corner = 0; corner < corners; corner++)
+					{
+						double value = plyRead(q + corner * indexSize, list.type, swap);
+						if (value < 0 || value >= (double)mesh.positions.size())
+							throw std::runtime_error(path + ": face index out of range");
+
+						uint32_t index = (uint32_t)value;
+						if (corner == 0)
+							first = index;
+						else if (corner >= 2)
+						{
+							mesh.indices[3 * tri] = first;
+							mesh.indices[3 * tri + 1] = previous;
+							mesh.indices[3 * tri + 2] = index;
+							tri++;
+						}
+						previous = index;
+					}
+
+					record += plyRecordSize(element, record, end, swap);
+				}
+			});
+		}
+		else if (element.fixedSize())
+		{
+			cursor += element.count * element.stride();
+		}
+		else
+		{
+			for (size_t i = 0; i < element.count; i++)
+			{
+				size_t size = plyRecordSize(element, cursor, end, swap);
+				if (size == 0)
+					throw std::runtime_error(path + ": truncated " + element.name + " data");
+				cursor += size;
+			}
+		}
+	}
+
+	return mesh;
+}
+
+/// <summary>
+/// Loads an .obj or .ply file by extension and reports how fast it was read.
+/// </summary>
+inline MeshData loadMesh(const std::string& path, MaterialTable& materials, MaterialId defaultMat, int threads = 0)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::string extension = std::filesystem::path(path).extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+
+	MeshData mesh;
+	if (extension == ".obj")
+		mesh = loadObj(path, materials, defaultMat, threads);
+	else if (extension == ".ply")
+		mesh = loadPly(path, threads);
+	else
+		throw std::runtime_error("Unknown mesh format: " + path);
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+	double megabytes = std::filesystem::file_size(path) / 1e6;
+
+	std::cout << "Mesh " << path << ": " << mesh.indices.size() / 3 << " triangles, " << megabytes << " MB in "
+		<< ms << " ms (" << (ms > 0 ? megabytes / (ms / 1000) : 0) << " MB/s)" << std::endl;
+	return mesh;
+}
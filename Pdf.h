@@ -1,6 +1,7 @@
 #pragma once
+#include <variant>
 #include "Vec.h"
-#include "Random.h"
+#include "Sampler.h"
 #include "Onb.h"
 #include "Hittable.h"
 
@@ -9,10 +10,10 @@ class Pdf
 public:
 	virtual ~Pdf() {}
 	virtual double value(const Vec& vec) const = 0;
-	virtual Vec generate(Random& rand) const = 0;
+	virtual Vec generate(Sampler& sampler) const = 0;
 };
 
-class SpherePdf : public Pdf
+class SpherePdf final : public Pdf
 {
 public:
 	double value(const Vec& vec) const override
@@ -20,13 +21,13 @@ public:
 		return 1.0 / (4.0 * pi);
 	}
 
-	Vec generate(Random& rand) const override
+	Vec generate(Sampler& sampler) const override
 	{
-		return rand.sampleUnitSphere();
+		return sampler.sampleUnitSphere();
 	}
 };
 
-class CosinePdf : public Pdf
+class CosinePdf final : public Pdf
 {
 private:
 	Onb onb;
@@ -43,9 +44,9 @@ public:
 		return cosTheta / pi;
 	}
 
-	Vec generate(Random& rand) const override
+	Vec generate(Sampler& sampler) const override
 	{
-		Vec vec = rand.sampleCosineHemisphere();
+		Vec vec = sampler.sampleCosineHemisphere();
 
 		return onb.localToWorld(vec);
 	}
@@ -66,29 +67,72 @@ public:
 	{
 		return hittable.pdf(origin, vec);
 	}
-	Vec generate(Random& rand) const override
+	Vec generate(Sampler& sampler) const override
 	{
-		return hittable.randomSample(rand, origin);
+		return hittable.randomSample(sampler, origin);
 	}
 };
 
+/// <summary>
+/// Pdf picked by a material. Holds one of a closed set of pdfs by value, so a ScatterRecord
+/// can be built on the stack for every bounce without allocating.
+/// </summary>
+class ScatterPdf final : public Pdf
+{
+private:
+	std::variant<std::monostate, CosinePdf, SpherePdf> pdf;
+public:
+	ScatterPdf() = default;
+
+	ScatterPdf(const CosinePdf& pdf) : pdf(pdf)
+	{
+	}
+
+	ScatterPdf(const SpherePdf& pdf) : pdf(pdf)
+	{
+	}
+
+	double value(const Vec& vec) const override
+	{
+		return std::visit([&](const auto& p) -> double
+		{
+			if constexpr (std::is_same_v<std::decay_t<decltype(p)>, std::monostate>)
+				return 0.0;
+			else
+				return p.value(vec);
+		}, pdf);
+	}
+
+	Vec generate(Sampler& sampler) const override
+	{
+		return std::visit([&](const auto& p) -> Vec
+		{
+			if constexpr (std::is_same_v<std::decay_t<decltype(p)>, std::monostate>)
+				return ZERO_VEC;
+			else
+				return p.generate(sampler);
+		}, pdf);
+	}
+};
+
+// References its two pdfs, which must outlive it. Meant to be built on the stack per bounce.
 class MixturePdf : public Pdf
 {
 private:
-	std::shared_ptr<Pdf> pdfA;
-	std::shared_ptr<Pdf> pdfB;
+	const Pdf& pdfA;
+	const Pdf& pdfB;
 	double ratio;
 public:
-	MixturePdf(const std::shared_ptr<Pdf>& pdfA, const std::shared_ptr<Pdf>& pdfB, double ratio = 0.5) : pdfA(pdfA), pdfB(pdfB), ratio(ratio)
+	MixturePdf(const Pdf& pdfA, const Pdf& pdfB, double ratio = 0.5) : pdfA(pdfA), pdfB(pdfB), ratio(ratio)
 	{
 
 	}
 	double value(const Vec& vec) const override
 	{
-		return ratio * pdfA->value(vec) + (1 - ratio) * pdfB->value(vec);
+		return ratio * pdfA.value(vec) + (1 - ratio) * pdfB.value(vec);
 	}
-	Vec generate(Random& rand) const override
+	Vec generate(Sampler& sampler) const override
 	{
-		return rand.randomDouble() > (1 - ratio) ? pdfA->generate(rand) : pdfB->generate(rand);
+		return sampler.get1D() > (1 - ratio) ? pdfA.generate(sampler) : pdfB.generate(sampler);
 	}
 };
\ No newline at end of file
@@ -2,4 +2,5 @@
 
 #include <glm/glm.hpp>
 
-using Point = glm::vec<3, double>;
\ No newline at end of file
+using Point = glm::vec<3, double>;
+using Point2 = glm::vec<2, double>; // a pair of sample dimensions
@@ -1,11 +1,12 @@
 #pragma once
 
 #include "Hittable.h"
+#include "Material.h"
 
 class Quad : public Hittable
 {
 public:
-	Quad(const Point& Q, const Vec& u, const Vec& v, std::shared_ptr<Material> mat)
+	Quad(const Point& Q, const Vec& u, const Vec& v, MaterialId mat)
 		: Q(Q), u(u), v(v), mat(mat)
 	{
 		n = glm::cross(u, v);
@@ -18,36 +19,34 @@ public:
 
 	bool hit(const Ray& ray, const Interval& interval, Hit& hit) const override
 	{
-		// find point of intersection on plane containing quad
-
-		// n * ((ray.origin() + t * ray.dir()) - P) = 0
-
-		double denom = glm::dot(n, ray.dir());
-
-		if (fabs(denom) < 1e-8)
-			return false;
+		double t;
 
-		double t = (D - glm::dot(n, ray.origin())) / denom;
-
-		if (!interval.surrounds(t))
+		if (!intersect(ray, interval, t))
 			return false;
 
-		Vec P = ray.at(t);
-		Vec p = P - Q;
-		double alpha = glm::dot(-w, glm::cross(v, p));
-		double beta = glm::dot(w, glm::cross(u, p));
-
-		Interval unitInterval(0, 1);
-
-		if (!unitInterval.surrounds(alpha) || !unitInterval.surrounds(beta))
-			return false;
-
-		hit.pos = P;
+		hit.pos = ray.at(t);
 		hit.t = t;
 		hit.mat = mat;
+		hit.object = this;
 		hit.setFaceNormal(ray, glm::normalize(n));
 		return true;
 	}
+
+	bool occluded(const Ray& ray, const Interval& interval) const override
+	{
+		double t;
+		return intersect(ray, interval, t);
+	}
+
+	Aabb boundingBox() const override
+	{
+		Aabb box(Q, Q + u + v);
+		box.grow(Q + u);
+		box.grow(Q + v);
+		box.pad(1e-4);
+		return box;
+	}
+
 	virtual double pdf(const Point& origin, const Point& dir) const
 	{
 		Ray ray(origin, dir);
@@ -66,21 +65,65 @@ public:
 		return d2 / (cosine * area);
 	}
 
-	virtual Vec randomSample(Random& rand, const Point& origin) const
+	virtual Vec randomSample(Sampler& sampler, const Point& origin) const
 	{
-		Point P = Q + rand.randomDouble() * u + rand.randomDouble() * v;
+		Point2 uv = sampler.get2D();
+		Point P = Q + uv.x * u + uv.y * v;
 		Vec vec = P - origin;
 
 		assert(glm::length(vec) > 0);
 		return glm::normalize(vec);
 	}
+	double power(const MaterialTable& materials) const override
+	{
+		// emits from the front face only
+		return area * pi * luminance(materials[mat].emission());
+	}
+
+	LightBounds lightBounds(const MaterialTable& materials) const override
+	{
+		// front face is the side n points to, emission covers the hemisphere around it
+		return LightBounds(boundingBox(), glm::normalize(n), power(materials), 1, 0);
+	}
 private:
+	friend class SceneCache;
+
 	Point Q;
 	Vec u;
 	Vec v;
 	Vec n;
 	Vec w;
 	double D;
-	std::shared_ptr<Material> mat;
+	MaterialId mat;
 	double area;
+
+	bool intersect(const Ray& ray, const Interval& interval, double& tHit) const
+	{
+		// find point of intersection on plane containing quad
+
+		// n * ((ray.origin() + t * ray.dir()) - P) = 0
+
+		double denom = glm::dot(n, ray.dir());
+
+		if (fabs(denom) < 1e-8)
+			return false;
+
+		double t = (D - glm::dot(n, ray.origin())) / denom;
+
+		if (!interval.surrounds(t))
+			return false;
+
+		Vec P = ray.at(t);
+		Vec p = P - Q;
+		double alpha = glm::dot(-w, glm::cross(v, p));
+		double beta = glm::dot(w, glm::cross(u, p));
+
+		Interval unitInterval(0, 1);
+
+		if (!unitInterval.surrounds(alpha) || !unitInterval.surrounds(beta))
+			return false;
+
+		tHit = t;
+		return true;
+	}
 };
\ No newline at end of file
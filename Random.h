@@ -1,93 +1,135 @@
 #pragma once
-#include <random>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
 #include "Point.h"
 #include "RayTracing.h"
+#include "Sampling.h"
 
+// 64-bit finalizer, spreads nearby seeds over the whole state space
+inline uint64_t mixBits(uint64_t v)
+{
+	v ^= (v >> 31);
+	v *= 0x7fb5d329728ea185ULL;
+	v ^= (v >> 27);
+	v *= 0x81dadef4bc2dd44dULL;
+	v ^= (v >> 33);
+	return v;
+}
+
+/// <summary>
+/// PCG32 generator (O'Neill): 64 bits of state plus a 64-bit stream selector, cheap enough to give
+/// every pixel sample its own generator. Distinct streams are statistically independent and any
+/// stream can be jumped ahead in O(log n), which forSample uses to address (pixel, sample, dimension).
+/// </summary>
 class Random
 {
 public:
-	Random() : generator(), distribution(0.0, 1.0)
+	Random() : state(DefaultState), inc(DefaultStream)
 	{
 	}
 
-	Random(int seed) : generator(seed), distribution(0.0, 1.0)
+	Random(uint64_t seed)
 	{
+		setSequence(seed, mixBits(seed));
 	}
 
-	double randomDouble()
+	/// <summary>
+	/// Generator for one sample of one pixel, already advanced past the first dimension draws.
+	/// Every pixel gets its own stream and every sample its own block of SampleStride draws in it,
+	/// so a sample's numbers do not depend on what was rendered before it or on which thread.
+	/// </summary>
+	static Random forSample(uint64_t pixel, uint64_t sample, uint64_t dimension = 0, uint64_t seed = 0)
 	{
-		return distribution(generator);
+		Random rand;
+		rand.setSequence(pixel, mixBits(pixel ^ mixBits(seed)));
+		rand.advance(sample * SampleStride + dimension);
+		return rand;
 	}
 
-	double randomDouble(double lower, double upper)
+	uint32_t randomUint32()
 	{
-		return lower + randomDouble() * (upper - lower);
+		uint64_t oldState = state;
+		state = oldState * Multiplier + inc;
+
+		uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+		uint32_t rot = (uint32_t)(oldState >> 59u);
+		return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
 	}
 
-	Point sampleUnitDisk()
+	// uniform in [0, 1) with a resolution of 2^-32, exact and never rounds up to 1
+	double randomDouble()
 	{
-		double uni1 = randomDouble(-1, 1);
-		double uni2 = randomDouble(-1, 1);
-
-		if (uni1 == 0 && uni2 == 0)
-			return Point(0, 0, 0);
+		return randomUint32() * 0x1p-32;
+	}
 
-		double theta, r;
+	// jump delta draws ahead (or back, modulo 2^64) without generating them
+	void advance(uint64_t delta)
+	{
+		uint64_t curMult = Multiplier, curPlus = inc;
+		uint64_t accMult = 1u, accPlus = 0u;
 
-		if (std::abs(uni1) > std::abs(uni2))
+		while (delta > 0)
 		{
-			r = uni1;
-			theta = pi / 4 * (uni2 / uni1);
-		}
-		else 
-		{
-			r = uni2;
-			theta = pi / 2 - pi / 4 * (uni1 / uni2);
+			if (delta & 1)
+			{
+				accMult *= curMult;
+				accPlus = accPlus * curMult + curPlus;
+			}
+			curPlus = (curMult + 1) * curPlus;
+			curMult *= curMult;
+			delta /= 2;
 		}
 
-		return r * Point(std::cos(theta), std::sin(theta), 0.0);
+		state = accMult * state + accPlus;
+	}
+
+	double randomDouble(double lower, double upper)
+	{
+		return lower + randomDouble() * (upper - lower);
+	}
+
+	Point2 random2D()
+	{
+		double u1 = randomDouble();
+		return Point2(u1, randomDouble());
+	}
+
+	Point sampleUnitDisk()
+	{
+		return uniformDisk(random2D());
 	}
 
 	Point sampleUnitSphere()
 	{
-		double uni1 = randomDouble();
-		double uni2 = randomDouble();
-		double z = 1 - 2 * uni2;
-		assert((1 - z * z) >= 0);
-		double sinPhi = sqrt(1 - z * z);
-		double x = cos(2 * pi * uni1) * sinPhi;
-		double y = sin(2 * pi * uni1) * sinPhi;
-		return Point(x, y, z);
+		return uniformSphere(random2D());
 	}
 
-	// Malley's method
 	Point sampleCosineHemisphere()
 	{
-		Point p = sampleUnitDisk();
-		double z2 = 1 - p.x * p.x - p.y * p.y;
-		assert(z2 >= 0);
-		p.z = sqrt(z2);
-		return p;
+		return cosineHemisphere(random2D());
 	}
 
 	Point sampleCone(double radius, double height)
 	{
-		double r1 = randomDouble();
-		double r2 = randomDouble();
-		
-		double cosMaxSquared = 1 - radius * radius / (height * height);
-		assert(cosMaxSquared >= 1e-8);
-		double cosMax = sqrt(cosMaxSquared);
-
-		double z = 1 + r2 * (cosMax - 1);
-		assert(z <= 1);
-		double phi = 2 * pi * r1;
-		double x = cos(phi) * sqrt(1 - z * z);
-		double y = sin(phi) * sqrt(1 - z * z);
-		return Point(x, y, z);
+		return uniformCone(random2D(), radius, height);
 	}
 
 private:
-	std::uniform_real_distribution<double> distribution;
-	std::mt19937 generator;
+	static constexpr uint64_t DefaultState = 0x853c49e6748fea9bULL;
+	static constexpr uint64_t DefaultStream = 0xda3e39cb94b95bdbULL;
+	static constexpr uint64_t Multiplier = 0x5851f42d4c957f2dULL;
+	static constexpr uint64_t SampleStride = 65536; // draws reserved per pixel sample
+
+	uint64_t state;
+	uint64_t inc; // stream selector, always odd
+
+	void setSequence(uint64_t sequence, uint64_t seed)
+	{
+		state = 0u;
+		inc = (sequence << 1u) | 1u;
+		randomUint32();
+		state += seed;
+		randomUint32();
+	}
 };
@@ -11,173 +11,267 @@
 #include "HittableList.h"
 #include "Camera.h"
 #include "Quad.h"
+#include "Bvh.h"
+#include "LightSampler.h"
+#include "ImageIO.h"
+#include "Scene.h"
+#include "SceneCache.h"
+#include "SphereSet.h"
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
 
 using namespace std;
 
-using MatPtr = std::shared_ptr<Material>;
+static void printUsage()
+{
+	std::cout << "Usage: RayTracing [scene file] [-o output.jpg] [--spp N] [--threads N] [--no-cache] [--frames N]" << std::endl
+		<< "       [--bvh binary|wide4|wide8] [--sphere-sets]" << std::endl
+		<< "  Renders the scene (default scenes/cornell.scene) to a JPEG, plus an EXR of the" << std::endl
+		<< "  linear radiance next to it. --spp and --threads override the scene's camera settings." << std::endl
+		<< "  The parsed scene and its BVH are cached in <scene file>.cache unless --no-cache." << std::endl
+		<< "  --frames renders an animation where some spheres drift, output_000.jpg and on, and" << std::endl
+		<< "  reports what keeping the BVH up to date costs per frame. --bvh picks the tree rays" << std::endl
+		<< "  traverse, by default the widest one this CPU has SIMD box tests for. --sphere-sets" << std::endl
+		<< "  groups the spheres that are not lights into SIMD-tested sets before the BVH is built." << std::endl;
+}
 
-void placeBox(HittableList& hittables, Point origin, double x, double y, double z, 
-	MatPtr bot, MatPtr top, MatPtr left, MatPtr right, MatPtr front, MatPtr back)
+// every 8th sphere that is neither a light nor one of the huge ground / dome spheres
+static std::vector<std::shared_ptr<Sphere>> pickMovingSpheres(const Scene& scene)
 {
-	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, -z), Vec(2 * x, 0, 0), Vec(0, 2 * y, 0), back));
-	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, z), Vec(2 * x, 0, 0), Vec(0, 2 * y, 0), front));
+	std::vector<std::shared_ptr<Sphere>> movers;
+	int candidates = 0;
 
-	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, -z), Vec(0, 2 * y, 0), Vec(0, 0, 2 * z), left));
-	hittables.add(std::make_shared<Quad>(origin + Point(x, -y, -z), Vec(0, 2 * y, 0), Vec(0, 0, 2 * z), right));
+	for (auto& object : scene.hittables.objects())
+	{
+		auto sphere = std::dynamic_pointer_cast<Sphere>(object);
+		if (!sphere || sphere->radiusLength() >= 1)
+			continue;
 
-	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, -z), Vec(2 * x, 0, 0), Vec(0, 0, 2 * z), bot));
-	hittables.add(std::make_shared<Quad>(origin + Point(-x, y, -z), Vec(2 * x, 0, 0), Vec(0, 0, 2 * z), top));
+		auto& lights = scene.lights.objects();
+		if (std::find(lights.begin(), lights.end(), object) != lights.end())
+			continue;
+
+		if (candidates++ % 8 == 0)
+			movers.push_back(sphere);
+	}
+	return movers;
 }
 
-int cornellBox()
+static std::string framePath(const std::string& outPath, int frame)
 {
-	CamParams params;
-	params.samplesPerPixel = 500;
-	params.imgWidth = 400;
-	params.vFov = 50.0;
-	params.pos = Point(0, 0.0, 2);
-	params.lookAt = Point(0, 0, -5);
-	params.defocusAngle = -1;
-	params.maxDepth = 10;
-	params.aspectRatio = 1.0;
-	Camera cam(params, Random(1));
-	// SCENE
-	HittableList hittables;
-	HittableList lights;
-
-	auto redMat = std::make_shared<Lambertian>(Color(1, 0, 0));
-	auto purpleMat = std::make_shared<Lambertian>(Color(1, 0.1, 1));
-	auto metalMat = std::make_shared<Metal>(Color(0.7, 1.0, 1), 0.1);
-	auto whiteMat = std::make_shared<Lambertian>(Color(1, 1, 1));
-	auto greenMat = std::make_shared<Lambertian>(Color(0, 1, 0));
-	auto glassMat = std::make_shared<Dielectric>(1.5);
-
-	auto lightMat = std::make_shared<Emissive>(15.0 * Color(1, 0.9, 0.8));
-	auto lightMatDim = std::make_shared<Emissive>(1.0 * Color(1, 0.8, 0.7));
-
-	Random rand(100);
-
-	auto color1 = std::make_shared<Emissive>(10.0 * Color(0.3, 0.9, 0.4));
-	auto color2 = std::make_shared<Emissive>(10.0 * Color(0.3, 0.3, 0.9));
-	auto color3 = std::make_shared<Emissive>(10.0 * Color(0.9, 0.3, 0.3));
-
-	std::shared_ptr<Emissive> colors[] = {color1, color2, color3};
-	// environment
-
-	placeBox(hittables, Point(0, 0, 0), 2, 2, 6, whiteMat, whiteMat, greenMat, redMat, whiteMat, whiteMat);
-
-	placeBox(hittables, Point(-0.5, -1, -5), 0.3, 1.5, 0.3, whiteMat, whiteMat, whiteMat, whiteMat, whiteMat, whiteMat);
-	placeBox(hittables, Point(0.65, -1.5, -3.5), 0.5, 0.5, 0.5,  metalMat, metalMat, metalMat, metalMat, metalMat, metalMat);
-
-	auto lt = std::make_shared<Quad>(Point(-0.5, 1.95, -5), Vec(1.0, 0, 0), Vec(0, 0, 1.0), lightMat);
-	hittables.add(lt);
-	lights.add(lt);
-
-	auto sphere = std::make_shared<Sphere>(Point(-0.7, -1.5, -3), 0.5, glassMat);
-	hittables.add(sphere);
-	//lights.add(sphere);
-
-	auto sphere2 = std::make_shared<Sphere>(Point(1.2, -1.8, -2.8), 0.2, purpleMat);
-	hittables.add(sphere2);
-//	lights.add(sphere2);
-
-	auto img = cam.render(hittables, lights);
-
-	if (stbi_write_jpg("test_img2.jpg", cam.imageWidth(), cam.imageHeight(), 3, img.data(), 100))
-		std::cout << "Success" << std::endl;
-	else 
-		std::cout << "Fail" << std::endl;
-
-	return 0;
+	std::filesystem::path path(outPath);
+	std::ostringstream name;
+	name << path.stem().string() << "_" << std::setw(3) << std::setfill('0') << frame << path.extension().string();
+	return (path.parent_path() / name.str()).string();
 }
 
-
-int raytrace()
+/// <summary>
+/// Renders frames of the scene with a few spheres drifting across it and bouncing, updating the
+/// BVH between frames with Bvh::update instead of building it again, and prints what each
+/// update did and cost next to the time of one full build.
+/// </summary>
+static void renderAnimation(Scene& scene, int frames, const std::string& outPath)
 {
-	CamParams params;
-	params.samplesPerPixel = 2000;
-	params.imgWidth = 300;
-	params.vFov = 20.0;
-	params.pos = Point(0, 2, 0);
-	params.lookAt = Point(0, 0, -5);
-	params.defocusAngle = -1;
-	params.maxDepth = 8;
-	Camera cam(params, Random(1));
-	// SCENE
-	HittableList hittables;
-
-	auto redMat = std::make_shared<Lambertian>(Color(1, 1, 1) * 0.8);
-	auto metalMat = std::make_shared<Metal>(Color(0.7, 1.0, 1), 0.0);
-	auto whiteMat = std::make_shared<Lambertian>(Color(1, 1.0, 1));
-	auto greenMat = std::make_shared<Lambertian>(Color(0.8, 0.8, 1) * 0.4);
-	auto glassMat = std::make_shared<Dielectric>(1.5);
-
-	// environment
-	hittables.add(std::make_shared<Sphere>(Point(0, -1000.3, -5), 1000, greenMat));
-	hittables.add(std::make_shared<Sphere>(Point(0, 0, 0), 6, redMat));
-	hittables.add(std::make_shared<Sphere>(Point(0, 3, 0), 1,
-				std::make_shared<Emissive>(0.5 * Color(1, 0.9, 0.8))));
-
-	Point ctPt = Point(0, 0, -5);
-
-	hittables.add(std::make_shared<Sphere>(ctPt, 0.3, metalMat));
-	//hittables.add(std::make_shared<Sphere>(Point(-0.8, 0.0, -5.7), 0.3, redMat));
-
-	Random rand(100);
-
-	auto color1 = std::make_shared<Emissive>(10.0 * Color(0.3, 0.9, 0.4));
-	auto color2 = std::make_shared<Emissive>(10.0 * Color(0.3, 0.3, 0.9));
-	auto color3 = std::make_shared<Emissive>(10.0 * Color(0.9, 0.3, 0.3));
-
-	std::shared_ptr<Emissive> colors[] = {color1, color2, color3};
-
-	for (int i = -3; i < 3; i++)
-	{
-		for (int j = -3; j < 3; j++)
-		{
-			if (i == 0 && j == 0)
-				continue;
+	auto movers = pickMovingSpheres(scene);
+	std::vector<Point> starts;
+	for (auto& sphere : movers)
+		starts.push_back(sphere->centerPoint());
+
+	Bvh reference(scene.hittables);
+	std::cout << "Animating " << movers.size() << " of " << scene.hittables.objects().size() << " objects, full BVH build takes "
+		<< reference.buildMilliseconds() << " ms" << std::endl;
 
-			Point pt = Point(0.6 * (rand.randomDouble(0, 0.7) + i), -0.2, 0.6 * (rand.randomDouble(0, 0.7) + j)) + ctPt;
-			double chooseMat = rand.randomDouble();
+	auto lightSampler = makeLightSampler(scene);
+	const char* actions[] = { "refit", "partial rebuild", "full rebuild" };
 
-			if (i == 2 && j == 2)
+	for (int frame = 0; frame < frames; frame++)
+	{
+		if (frame > 0)
+		{
+			for (int i = 0; i < (int)movers.size(); i++)
 			{
-				hittables.add(std::make_shared<Sphere>(pt + Point(0, 0.2, 0), 0.3, glassMat));
-				continue;
+				// each sphere heads its own way (golden angle apart) and hops
+				double angle = 2.39996 * i;
+				double distance = 0.05 * frame;
+				double hop = 0.3 * std::fabs(std::sin(0.5 * frame + i));
+				movers[i]->moveTo(starts[i] + Vec(distance * std::cos(angle), hop, distance * std::sin(angle)));
 			}
 
-			if (chooseMat < 0.2) {
-				hittables.add(std::make_shared<Sphere>(pt, 0.1, glassMat));
+			Bvh::UpdateStats stats = scene.bvh->update();
+			std::cout << "Frame " << frame << ": " << actions[(int)stats.action] << " in " << stats.milliseconds << " ms";
+			if (stats.action == Bvh::UpdateAction::PartialRebuild)
+				std::cout << " (" << stats.rebuiltPrimitives << " objects)";
+			std::cout << ", SAH cost x" << stats.costGrowth << std::endl;
+		}
+
+		Camera cam(scene.camera, Random(scene.seed));
+		scene.bvh->resetStats();
+
+		auto renderStart = std::chrono::high_resolution_clock::now();
+		auto img = cam.render(*scene.bvh, *lightSampler, scene.materials);
+		auto renderStop = std::chrono::high_resolution_clock::now();
+
+		std::cout << "Frame " << frame << ": rendered in " << std::chrono::duration<double, std::milli>(renderStop - renderStart).count()
+			<< " ms, BVH node visits per ray " << scene.bvh->averageNodeVisits() << std::endl;
+
+		std::string path = framePath(outPath, frame);
+		if (!stbi_write_jpg(path.c_str(), cam.imageWidth(), cam.imageHeight(), 3, img.data(), 100))
+			std::cout << "Fail writing " << path << std::endl;
+	}
+}
+
+static bool parseInt(const char* text, int& value)
+{
+	auto end = text + std::strlen(text);
+	auto result = std::from_chars(text, end, value);
+	return result.ec == std::errc() && result.ptr == end;
+}
+
+int main(int argc, char** argv)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::string scenePath = "scenes/cornell.scene";
+	std::string outPath = "test_img2.jpg";
+	int spp = -1;
+	int threads = -1;
+	bool useCache = true;
+	int frames = 0;
+	BvhLayout layout = defaultBvhLayout();
+	bool sphereSets = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "-h" || arg == "--help")
+		{
+			printUsage();
+			return 0;
+		}
+		else if (arg == "--no-cache")
+		{
+			useCache = false;
+		}
+		else if (arg == "--sphere-sets")
+		{
+			sphereSets = true;
+		}
+		else if (arg == "-o" && hasValue)
+		{
+			outPath = argv[++i];
+		}
+		else if (arg == "--spp" && hasValue)
+		{
+			if (!parseInt(argv[++i], spp) || spp < 1)
+			{
+				std::cerr << "--spp needs a positive integer" << std::endl;
+				return 1;
 			}
-			else if (chooseMat < 0.35)
+		}
+		else if (arg == "--threads" && hasValue)
+		{
+			if (!parseInt(argv[++i], threads) || threads < 0)
 			{
-				hittables.add(std::make_shared<Sphere>(pt, 0.1,
-					std::make_shared<Lambertian>(Color(rand.randomDouble(0, 1), rand.randomDouble(0, 1.0), rand.randomDouble(0, 1.0)))));
+				std::cerr << "--threads needs a non-negative integer" << std::endl;
+				return 1;
 			}
-			else if (chooseMat < 0.5)
+		}
+		else if (arg == "--bvh" && hasValue)
+		{
+			std::string name = argv[++i];
+			if (name == "binary") layout = BvhLayout::Binary;
+			else if (name == "wide4") layout = BvhLayout::Wide4;
+			else if (name == "wide8") layout = BvhLayout::Wide8;
+			else
 			{
-				hittables.add(std::make_shared<Sphere>(pt, 0.1,
-					std::make_shared<Metal>(Color(rand.randomDouble(0, 1), rand.randomDouble(0, 1.0), rand.randomDouble(0, 1.0)), 0.1)));
+				std::cerr << "--bvh needs binary, wide4 or wide8" << std::endl;
+				return 1;
 			}
-			else if (chooseMat < 0.6)
+		}
+		else if (arg == "--frames" && hasValue)
+		{
+			if (!parseInt(argv[++i], frames) || frames < 1)
 			{
-				hittables.add(std::make_shared<Sphere>(pt + Point(0, 0.1, 0), 0.2, colors[(int)rand.randomDouble(0, 3)]));
+				std::cerr << "--frames needs a positive integer" << std::endl;
+				return 1;
 			}
 		}
+		else if (!arg.empty() && arg[0] != '-')
+		{
+			scenePath = arg;
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
 	}
 
-	auto img = cam.render(hittables, Quad(Point(0, 0, 0), Vec(1, 0, 0), Vec(0, 1, 0), whiteMat));
+	if (sphereSets && frames > 0)
+	{
+		std::cerr << "--sphere-sets cannot be combined with --frames, grouped spheres do not move" << std::endl;
+		return 1;
+	}
 
-	if (stbi_write_jpg("test_img2.jpg", cam.imageWidth(), cam.imageHeight(), 3, img.data(), 100))
-		std::cout << "Success" << std::endl;
-	else 
-		std::cout << "Fail" << std::endl;
+	try
+	{
+		Scene scene = loadScene(scenePath, useCache);
 
-	return 0;
-}
+		if (sphereSets)
+		{
+			scene.hittables = SphereSet::group(scene.hittables, scene.lights);
+			scene.bvh = std::make_unique<Bvh>(scene.hittables);
+			std::cout << "Sphere sets: BVH over " << scene.hittables.objects().size() << " primitives, " << scene.bvh->nodeCount()
+				<< " nodes built in " << scene.bvh->buildMilliseconds() << " ms" << std::endl;
+		}
 
-int main()
-{
-	return cornellBox();
+		if (spp > 0)
+			scene.camera.samplesPerPixel = spp;
+		if (threads >= 0)
+			scene.camera.threadCount = threads;
+
+		scene.bvh->setLayout(layout);
+		const char* layoutNames[] = { "binary", "4 wide", "8 wide" };
+		std::cout << "BVH layout: " << layoutNames[(int)layout] << ", " << simdName(scene.bvh->simdLevel()) << " box tests" << std::endl;
+
+		if (frames > 0)
+		{
+			renderAnimation(scene, frames, outPath);
+			return 0;
+		}
+
+		Camera cam(scene.camera, Random(scene.seed));
+
+		auto lightSampler = makeLightSampler(scene);
+
+		// startup cost of a render: everything before the first sample is taken
+		auto ready = std::chrono::high_resolution_clock::now();
+		std::cout << "Time to first pixel: " << std::chrono::duration<double, std::milli>(ready - start).count() << " ms" << std::endl;
+
+		auto img = cam.render(*scene.bvh, *lightSampler, scene.materials);
+		std::cout << "BVH node visits per ray: " << scene.bvh->averageNodeVisits() << std::endl;
+
+		if (stbi_write_jpg(outPath.c_str(), cam.imageWidth(), cam.imageHeight(), 3, img.data(), 100))
+			std::cout << "Success" << std::endl;
+		else
+			std::cout << "Fail" << std::endl;
+
+		// unclamped linear radiance, for re-exposing or merging renders later
+		std::string exrPath = std::filesystem::path(outPath).replace_extension(".exr").string();
+		if (!writeExr(exrPath, cam.imageWidth(), cam.imageHeight(), cam.linearImage().data()))
+			std::cout << "Fail writing EXR" << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
 }
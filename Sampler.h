@@ -0,0 +1,187 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "Point.h"
+#include "Random.h"
+#include "Sampling.h"
+
+enum class SamplerType
+{
+	Independent, // fresh uniform numbers for every dimension
+	Sobol // padded, Owen-scrambled Sobol points
+};
+
+/// <summary>
+/// Supplies the uniform numbers for one pixel sample, one dimension at a time: camera jitter, lens,
+/// then whatever each bounce asks for. Everything that samples during rendering draws from here.
+///
+/// Sobol pads 1D and 2D Sobol points: every dimension (pair) uses the first two Sobol dimensions,
+/// decorrelated from the others by shuffling the sample index and Owen-scrambling the bits with
+/// hashes of (pixel, dimension, seed). Each dimension on its own is then stratified across the
+/// pixel's samples no matter how many dimensions a path ends up using. Works best with a power of
+/// two samples per pixel.
+/// </summary>
+class Sampler
+{
+public:
+	Sampler(SamplerType type, int samplesPerPixel, uint64_t seed = 0)
+		: type(type), samplesPerPixel(std::max(1, samplesPerPixel)), seed(seed)
+	{
+	}
+
+	void startPixelSample(uint64_t pixel, int sampleIndex, int dimension = 0)
+	{
+		this->pixel = pixel;
+		this->sampleIndex = sampleIndex;
+		this->dimension = dimension;
+
+		if (type == SamplerType::Independent)
+			rand = Random::forSample(pixel, sampleIndex, dimension, seed);
+	}
+
+	double get1D()
+	{
+		if (type == SamplerType::Independent)
+			return rand.randomDouble();
+
+		uint64_t hash = dimensionHash();
+		uint32_t index = sobolIndex((uint32_t)hash);
+		dimension++;
+		return sobolSample(index, 0, (uint32_t)(hash >> 32));
+	}
+
+	Point2 get2D()
+	{
+		if (type == SamplerType::Independent)
+			return rand.random2D();
+
+		uint64_t hash = dimensionHash();
+		uint32_t index = sobolIndex((uint32_t)hash);
+		dimension += 2;
+		return Point2(sobolSample(index, 0, (uint32_t)hash), sobolSample(index, 1, (uint32_t)(hash >> 32)));
+	}
+
+	Point sampleUnitDisk()
+	{
+		return uniformDisk(get2D());
+	}
+
+	Point sampleUnitSphere()
+	{
+		return uniformSphere(get2D());
+	}
+
+	Point sampleCosineHemisphere()
+	{
+		return cosineHemisphere(get2D());
+	}
+
+	Point sampleCone(double radius, double height)
+	{
+		return uniformCone(get2D(), radius, height);
+	}
+
+private:
+	SamplerType type;
+	int samplesPerPixel;
+	uint64_t seed;
+
+	uint64_t pixel = 0;
+	int sampleIndex = 0;
+	int dimension = 0;
+	Random rand; // Independent only
+
+	uint64_t dimensionHash() const
+	{
+		return mixBits(mixBits(mixBits(seed) ^ pixel) ^ (uint64_t)dimension);
+	}
+
+	// Shuffled sample index within the pixel's block of samplesPerPixel Sobol points. Indices past
+	// the block (a resumed render asking for more samples) carry on into the next, shuffled anew.
+	uint32_t sobolIndex(uint32_t hash) const
+	{
+		uint32_t block = (uint32_t)sampleIndex / samplesPerPixel;
+		uint32_t offset = (uint32_t)sampleIndex % samplesPerPixel;
+		return block * samplesPerPixel + permutationElement(offset, samplesPerPixel, hash ^ (uint32_t)mixBits(block));
+	}
+
+	static uint32_t reverseBits(uint32_t v)
+	{
+		v = (v << 16) | (v >> 16);
+		v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+		v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+		v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+		v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+		return v;
+	}
+
+	// Sobol dimension 0 is the van der Corput sequence; dimension 1's generator matrix is the
+	// Pascal matrix mod 2, whose columns follow from each other by v ^= v >> 1
+	static double sobolSample(uint32_t index, int sobolDimension, uint32_t scramble)
+	{
+		uint32_t v;
+
+		if (sobolDimension == 0)
+		{
+			v = reverseBits(index);
+		}
+		else
+		{
+			v = 0;
+			for (uint32_t column = 1u << 31; index; index >>= 1, column ^= column >> 1)
+			{
+				if (index & 1)
+					v ^= column;
+			}
+		}
+
+		return owenScramble(v, scramble) * 0x1p-32;
+	}
+
+	// hash-based Owen scrambling (Burley): each bit is flipped depending only on the bits above it
+	static uint32_t owenScramble(uint32_t v, uint32_t seed)
+	{
+		v = reverseBits(v);
+		v ^= v * 0x3d20adea;
+		v += seed;
+		v *= (seed >> 16) | 1;
+		v ^= v * 0x05526c56;
+		v ^= v * 0x53a22864;
+		return reverseBits(v);
+	}
+
+	// element i of a pseudo-random permutation of [0, length) picked by p (Kensler)
+	static int permutationElement(uint32_t i, uint32_t length, uint32_t p)
+	{
+		uint32_t w = length - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+
+		do
+		{
+			i ^= p;
+			i *= 0xe170893d;
+			i ^= p >> 16;
+			i ^= (i & w) >> 4;
+			i ^= p >> 8;
+			i *= 0x0929eb3f;
+			i ^= p >> 23;
+			i ^= (i & w) >> 1;
+			i *= 1 | p >> 27;
+			i *= 0x6935fa69;
+			i ^= (i & w) >> 11;
+			i *= 0x74dcb303;
+			i ^= (i & w) >> 2;
+			i *= 0x9e501cc3;
+			i ^= (i & w) >> 2;
+			i *= 0xc860a3df;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= length);
+
+		return (int)((i + p) % length);
+	}
+};
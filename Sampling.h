@@ -0,0 +1,67 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include "Point.h"
+#include "RayTracing.h"
+
+// Warps from uniform numbers in [0, 1)^2 to the distributions the renderer samples. They take their
+// inputs instead of drawing them so Random and Sampler can feed them independent or stratified numbers.
+
+// concentric mapping (Shirley-Chiu), keeps strata of the square compact on the disk
+inline Point uniformDisk(const Point2& u)
+{
+	double uni1 = 2 * u.x - 1;
+	double uni2 = 2 * u.y - 1;
+
+	if (uni1 == 0 && uni2 == 0)
+		return Point(0, 0, 0);
+
+	double theta, r;
+
+	if (std::abs(uni1) > std::abs(uni2))
+	{
+		r = uni1;
+		theta = pi / 4 * (uni2 / uni1);
+	}
+	else
+	{
+		r = uni2;
+		theta = pi / 2 - pi / 4 * (uni1 / uni2);
+	}
+
+	return r * Point(std::cos(theta), std::sin(theta), 0.0);
+}
+
+inline Point uniformSphere(const Point2& u)
+{
+	double z = 1 - 2 * u.y;
+	assert((1 - z * z) >= 0);
+	double sinPhi = sqrt(1 - z * z);
+	double x = cos(2 * pi * u.x) * sinPhi;
+	double y = sin(2 * pi * u.x) * sinPhi;
+	return Point(x, y, z);
+}
+
+// Malley's method
+inline Point cosineHemisphere(const Point2& u)
+{
+	Point p = uniformDisk(u);
+	double z2 = 1 - p.x * p.x - p.y * p.y;
+	p.z = sqrt(std::max(0.0, z2));
+	return p;
+}
+
+// directions around +z toward a sphere of the given radius whose center is height away
+inline Point uniformCone(const Point2& u, double radius, double height)
+{
+	double cosMaxSquared = 1 - radius * radius / (height * height);
+	assert(cosMaxSquared >= 1e-8);
+	double cosMax = sqrt(cosMaxSquared);
+
+	double z = 1 + u.y * (cosMax - 1);
+	assert(z <= 1);
+	double phi = 2 * pi * u.x;
+	double x = cos(phi) * sqrt(1 - z * z);
+	double y = sin(phi) * sqrt(1 - z * z);
+	return Point(x, y, z);
+}
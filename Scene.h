@@ -0,0 +1,475 @@
+#pragma once
+#include <charconv>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "Bvh.h"
+#include "Camera.h"
+#include "HittableList.h"
+#include "Instance.h"
+#include "LightSampler.h"
+#include "Material.h"
+#include "MeshImport.h"
+#include "Quad.h"
+#include "Sphere.h"
+#include "TriangleMesh.h"
+
+enum class LightSamplerType
+{
+	Uniform,
+	Power,
+	Bvh
+};
+
+// Everything a render needs. The parser fills in all but bvh, which loadScene (SceneCache.h) builds
+// over hittables or reads from the scene cache.
+struct Scene
+{
+	CamParams camera;
+	uint64_t seed = 1; // seeds the camera's Random
+	MaterialTable materials;
+	HittableList hittables;
+	HittableList lights; // also in hittables
+	LightSamplerType lightSampler = LightSamplerType::Power;
+	std::unique_ptr<Bvh> bvh;
+};
+
+inline void placeBox(HittableList& hittables, Point origin, double x, double y, double z,
+	MaterialId bot, MaterialId top, MaterialId left, MaterialId right, MaterialId front, MaterialId back)
+{
+	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, -z), Vec(2 * x, 0, 0), Vec(0, 2 * y, 0), back));
+	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, z), Vec(2 * x, 0, 0), Vec(0, 2 * y, 0), front));
+
+	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, -z), Vec(0, 2 * y, 0), Vec(0, 0, 2 * z), left));
+	hittables.add(std::make_shared<Quad>(origin + Point(x, -y, -z), Vec(0, 2 * y, 0), Vec(0, 0, 2 * z), right));
+
+	hittables.add(std::make_shared<Quad>(origin + Point(-x, -y, -z), Vec(2 * x, 0, 0), Vec(0, 0, 2 * z), bot));
+	hittables.add(std::make_shared<Quad>(origin + Point(-x, y, -z), Vec(2 * x, 0, 0), Vec(0, 0, 2 * z), top));
+}
+
+inline std::unique_ptr<LightSampler> makeLightSampler(const Scene& scene)
+{
+	switch (scene.lightSampler)
+	{
+	case LightSamplerType::Uniform:
+		return std::make_unique<UniformLightSampler>(scene.lights);
+	case LightSamplerType::Bvh:
+		return std::make_unique<LightBvh>(scene.lights, scene.materials);
+	default:
+		return std::make_unique<PowerLightSampler>(scene.lights, scene.materials);
+	}
+}
+
+/// <summary>
+/// Reads the text scene format: one statement per line, whitespace-separated, '#' starts a comment.
+///
+///   camera width 400                      (also aspect, fov, position, lookat, up, focus, defocus,
+///   camera position 0 0 2                  spp, depth, background, threads, tile, roulette,
+///                                          sampler sobol|independent, adaptive error min max,
+///                                          passes, checkpoint, processes, seed)
+///   material white lambertian 1 1 1
+///   material steel metal 0.7 1 1 0.1      (albedo, fuzz)
+///   material glass dielectric 1.5
+///   material lamp emissive 15 13.5 12
+///   sphere -0.7 -1.5 -3 0.5 glass         (center, radius, material)
+///   quad -0.5 1.95 -5 1 0 0 0 0 1 lamp    (corner, u, v, material)
+///   box 0 0 0 2 2 6 white white green red white white
+///                                         (center, half extents, bottom top left right front back)
+///   mesh models/bunny.obj white           (.obj or binary .ply relative to the scene file; an OBJ's
+///                                          own MTL materials override this one where it sets them)
+///   light sphere ... / light quad ... / light mesh ... / light instance ...
+///                                         (same as above, and sampled by next-event estimation)
+///   lightsampler power|uniform|bvh
+///
+///   object crate                          (shapes up to "end" form one shared object with its own
+///   box 0 0 0 0.5 0.5 0.5 steel ...        Bvh instead of going into the scene)
+///   end
+///   instance crate scale 2 2 2 rotate 0 1 0 30 translate 1 0 -3
+///                                         (a copy of an object, transformed in the order given)
+///
+/// Materials and objects have to be declared before use; objects may instance earlier objects. Errors throw std::runtime_error as "file:line: message".
+/// Works on the whole text at once and numbers go through std::from_chars, no streams per token.
+/// </summary>
+class SceneParser
+{
+public:
+	static Scene parse(std::string_view text, const std::string& name = "scene")
+	{
+		SceneParser parser(text, name);
+		parser.parseAll();
+		return std::move(parser.scene);
+	}
+
+private:
+	std::string_view text;
+	std::string name;
+	size_t pos = 0;
+	int line = 0;
+	std::string_view rest; // unparsed remainder of the current line
+
+	Scene scene;
+	std::unordered_map<std::string, MaterialId> materialIds;
+	std::unordered_map<std::string, std::shared_ptr<const Hittable>> objects;
+
+	// the object between "object" and "end", shapes go there instead of into the scene
+	std::string objectName;
+	HittableList objectShapes;
+	bool inObject = false;
+
+	SceneParser(std::string_view text, const std::string& name) : text(text), name(name)
+	{
+	}
+
+	void parseAll()
+	{
+		while (nextLine())
+		{
+			std::string_view keyword = word();
+			if (keyword.empty())
+				continue;
+
+			if (keyword == "camera")
+				parseCamera();
+			else if (keyword == "material")
+				parseMaterial();
+			else if (keyword == "sphere" || keyword == "quad" || keyword == "mesh" || keyword == "instance")
+				parseShape(keyword, false);
+			else if (keyword == "light")
+				parseShape(word(), true);
+			else if (keyword == "object")
+				beginObject();
+			else if (keyword == "end")
+				endObject();
+			else if (keyword == "box")
+				parseBox();
+			else if (keyword == "lightsampler")
+				parseLightSampler();
+			else
+				fail("unknown statement '" + std::string(keyword) + "'");
+
+			if (!word().empty())
+				fail("unexpected trailing input");
+		}
+
+		if (inObject)
+			fail("object '" + objectName + "' has no end");
+	}
+
+	void parseCamera()
+	{
+		CamParams& cam = scene.camera;
+		std::string_view key = word();
+
+		if (key == "width") cam.imgWidth = integer();
+		else if (key == "aspect") cam.aspectRatio = number();
+		else if (key == "fov") cam.vFov = number();
+		else if (key == "position") cam.pos = vec();
+		else if (key == "lookat") cam.lookAt = vec();
+		else if (key == "up") cam.upDir = vec();
+		else if (key == "focus") cam.focalDist = number();
+		else if (key == "defocus") cam.defocusAngle = number();
+		else if (key == "spp") cam.samplesPerPixel = integer();
+		else if (key == "depth") cam.maxDepth = integer();
+		else if (key == "background") cam.background = vec();
+		else if (key == "threads") cam.threadCount = integer();
+		else if (key == "tile") cam.tileSize = integer();
+		else if (key == "roulette") cam.rouletteDepth = integer();
+		else if (key == "passes") cam.progressivePassSpp = integer();
+		else if (key == "checkpoint") cam.checkpointPath = std::string(expectWord("checkpoint path"));
+		else if (key == "processes") cam.processCount = integer();
+		else if (key == "seed") scene.seed = (uint64_t)integer();
+		else if (key == "sampler")
+		{
+			std::string_view type = word();
+			if (type == "sobol") cam.sampler = SamplerType::Sobol;
+			else if (type == "independent") cam.sampler = SamplerType::Independent;
+			else fail("sampler must be sobol or independent");
+		}
+		else if (key == "adaptive")
+		{
+			cam.adaptiveTargetError = number();
+			cam.adaptiveMinSpp = integer();
+			cam.adaptiveMaxSpp = integer();
+		}
+		else fail("unknown camera setting '" + std::string(key) + "'");
+	}
+
+	void parseMaterial()
+	{
+		std::string materialName(expectWord("material name"));
+		std::string_view type = word();
+
+		if (materialIds.count(materialName))
+			fail("material '" + materialName + "' already defined");
+
+		MaterialId id;
+		if (type == "lambertian")
+		{
+			id = scene.materials.add(Lambertian(vec()));
+		}
+		else if (type == "metal")
+		{
+			Color albedo = vec();
+			double fuzz = number();
+			if (fuzz < 0.0 || fuzz > 1.0)
+				fail("metal fuzz must be in [0, 1]");
+			id = scene.materials.add(Metal(albedo, fuzz));
+		}
+		else if (type == "dielectric")
+		{
+			id = scene.materials.add(Dielectric(number()));
+		}
+		else if (type == "emissive")
+		{
+			id = scene.materials.add(Emissive(vec()));
+		}
+		else
+		{
+			fail("unknown material type '" + std::string(type) + "'");
+		}
+
+		materialIds[materialName] = id;
+	}
+
+	void parseShape(std::string_view shape, bool isLight)
+	{
+		std::shared_ptr<Hittable> hittable;
+
+		if (shape == "sphere")
+		{
+			Point center = vec();
+			double radius = number();
+			hittable = std::make_shared<Sphere>(center, radius, material());
+		}
+		else if (shape == "quad")
+		{
+			Point q = vec();
+			Vec u = vec();
+			Vec v = vec();
+			hittable = std::make_shared<Quad>(q, u, v, material());
+		}
+		else if (shape == "mesh")
+		{
+			hittable = parseMesh();
+		}
+		else if (shape == "instance")
+		{
+			hittable = parseInstance();
+		}
+		else
+		{
+			fail("expected sphere, quad, mesh or instance");
+		}
+
+		if (isLight && inObject)
+			fail("lights inside objects are not supported, make the instance a light instead");
+
+		target().add(hittable);
+		if (isLight)
+			scene.lights.add(hittable);
+	}
+
+	std::shared_ptr<Hittable> parseInstance()
+	{
+		std::string objectName(expectWord("an object name"));
+		auto it = objects.find(objectName);
+		if (it == objects.end())
+			fail("unknown object '" + objectName + "'");
+
+		Transform toWorld;
+		for (std::string_view op = word(); !op.empty(); op = word())
+		{
+			if (op == "translate")
+			{
+				toWorld = Transform::translate(vec()) * toWorld;
+			}
+			else if (op == "scale")
+			{
+				Vec factors = vec();
+				if (factors.x == 0 || factors.y == 0 || factors.z == 0)
+					fail("scale factors must not be zero");
+				toWorld = Transform::scale(factors) * toWorld;
+			}
+			else if (op == "rotate")
+			{
+				Vec axis = vec();
+				if (glm::dot(axis, axis) == 0)
+					fail("rotation axis must not be zero");
+				toWorld = Transform::rotate(axis, number()) * toWorld;
+			}
+			else
+			{
+				fail("expected translate, scale or rotate");
+			}
+		}
+
+		return std::make_shared<Instance>(it->second, toWorld);
+	}
+
+	void beginObject()
+	{
+		if (inObject)
+			fail("objects cannot be nested, end '" + objectName + "' first");
+
+		objectName = std::string(expectWord("object name"));
+		if (objects.count(objectName))
+			fail("object '" + objectName + "' already defined");
+
+		objectShapes = HittableList();
+		inObject = true;
+	}
+
+	void endObject()
+	{
+		if (!inObject)
+			fail("end without object");
+		if (objectShapes.objects().empty())
+			fail("object '" + objectName + "' is empty");
+
+		// a single shape needs no hierarchy of its own
+		auto& shapes = objectShapes.objects();
+		objects[objectName] = shapes.size() == 1 ? shapes[0] : std::make_shared<Bvh>(objectShapes);
+		inObject = false;
+	}
+
+	HittableList& target()
+	{
+		return inObject ? objectShapes : scene.hittables;
+	}
+
+	std::shared_ptr<Hittable> parseMesh()
+	{
+		std::string path(expectWord("mesh path"));
+		MaterialId mat = material();
+
+		std::filesystem::path file(path);
+		if (file.is_relative())
+			file = std::filesystem::path(name).parent_path() / file;
+
+		try
+		{
+			MeshData data = loadMesh(file.string(), scene.materials, mat, scene.camera.threadCount);
+			return std::make_shared<TriangleMesh>(std::move(data.positions), std::move(data.indices), mat,
+				std::move(data.normals), std::move(data.triangleMaterials));
+		}
+		catch (const std::exception& e)
+		{
+			fail(e.what());
+		}
+	}
+
+	void parseBox()
+	{
+		Point center = vec();
+		Vec half = vec();
+
+		MaterialId faces[6];
+		for (auto& face : faces)
+			face = material();
+
+		placeBox(target(), center, half.x, half.y, half.z, faces[0], faces[1], faces[2], faces[3], faces[4], faces[5]);
+	}
+
+	void parseLightSampler()
+	{
+		std::string_view type = word();
+		if (type == "uniform") scene.lightSampler = LightSamplerType::Uniform;
+		else if (type == "power") scene.lightSampler = LightSamplerType::Power;
+		else if (type == "bvh") scene.lightSampler = LightSamplerType::Bvh;
+		else fail("lightsampler must be uniform, power or bvh");
+	}
+
+	// Moves rest to the next line with any comment cut off. False at the end of the text.
+	bool nextLine()
+	{
+		if (pos >= text.size())
+			return false;
+
+		size_t end = text.find('\n', pos);
+		if (end == std::string_view::npos)
+			end = text.size();
+
+		rest = text.substr(pos, end - pos);
+		pos = end + 1;
+		line++;
+
+		size_t comment = rest.find('#');
+		if (comment != std::string_view::npos)
+			rest = rest.substr(0, comment);
+		return true;
+	}
+
+	// next whitespace-separated token of the line, empty at its end
+	std::string_view word()
+	{
+		size_t begin = 0;
+		while (begin < rest.size() && isSpace(rest[begin]))
+			begin++;
+
+		size_t end = begin;
+		while (end < rest.size() && !isSpace(rest[end]))
+			end++;
+
+		std::string_view token = rest.substr(begin, end - begin);
+		rest = rest.substr(end);
+		return token;
+	}
+
+	std::string_view expectWord(const char* what)
+	{
+		std::string_view token = word();
+		if (token.empty())
+			fail(std::string("expected ") + what);
+		return token;
+	}
+
+	double number()
+	{
+		std::string_view token = expectWord("a number");
+		double value;
+		auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+		if (result.ec != std::errc() || result.ptr != token.data() + token.size())
+			fail("'" + std::string(token) + "' is not a number");
+		return value;
+	}
+
+	long long integer()
+	{
+		std::string_view token = expectWord("an integer");
+		long long value;
+		auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+		if (result.ec != std::errc() || result.ptr != token.data() + token.size())
+			fail("'" + std::string(token) + "' is not an integer");
+		return value;
+	}
+
+	Vec vec()
+	{
+		double x = number();
+		double y = number();
+		return Vec(x, y, number());
+	}
+
+	MaterialId material()
+	{
+		std::string_view token = expectWord("a material name");
+		auto it = materialIds.find(std::string(token));
+		if (it == materialIds.end())
+			fail("unknown material '" + std::string(token) + "'");
+		return it->second;
+	}
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	[[noreturn]] void fail(const std::string& message) const
+	{
+		throw std::runtime_error(name + ":" + std::to_string(line) + ": " + message);
+	}
+};
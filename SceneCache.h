@@ -0,0 +1,441 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "Bvh.h"
+#include "MappedFile.h"
+#include "Quad.h"
+#include "Scene.h"
+#include "Sphere.h"
+
+// Material alternatives are plain values, so the table is stored as its raw bytes
+static_assert(std::is_trivially_copyable_v<Material>, "Scene cache stores materials as raw bytes");
+
+// Numeric camera settings as stored in the cache; the checkpoint path goes into its own section.
+struct CachedCamera
+{
+	double aspectRatio, focalDist, defocusAngle, vFov;
+	double pos[3], lookAt[3], upDir[3], background[3];
+	double rouletteMinSurvival, rouletteMaxSurvival, adaptiveTargetError;
+	int32_t samplesPerPixel, maxDepth, imgWidth, threadCount, tileSize, rouletteDepth;
+	int32_t sampler, adaptiveMinSpp, adaptiveMaxSpp, progressivePassSpp, processCount, pad;
+};
+
+struct CachedPrimitive
+{
+	uint32_t type; // SceneCache::SphereType or QuadType
+	MaterialId mat;
+	uint32_t listIndex; // position in the scene's hittables, which equal-distance hits are settled by
+	uint32_t pad;
+	double data[9]; // sphere: center, radius; quad: Q, u, v
+};
+
+// byte offset from the start of the file and element count
+struct CacheSection
+{
+	uint64_t offset;
+	uint64_t count;
+};
+
+struct SceneCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t materialSize; // sizeof(Material) of the writer, the raw bytes are only valid for the same layout
+	uint32_t lightSampler;
+	uint64_t seed;
+	CachedCamera camera;
+	CacheSection checkpointPath; // chars
+	CacheSection materials; // Material
+	CacheSection primitives; // CachedPrimitive, in BVH leaf order
+	CacheSection lights; // uint32_t index into primitives, in the scene's light order
+	CacheSection nodes; // BvhNode
+};
+
+/// <summary>
+/// Binary form of a parsed scene with its BVH already built, so that short renders of big scenes
+/// do not parse and build on every run. Everything is addressed by offsets from the start of the
+/// file, nothing holds a pointer, so the file is mapped and used in place: the BVH traverses the
+/// mapped nodes directly and only the primitives get their (cheap) objects back.
+/// A cache belongs to the scene text it was built from through sourceHash; any change to the
+/// text, the format version or the material layout turns it into a miss and it is rebuilt.
+/// </summary>
+class SceneCache
+{
+public:
+	static constexpr uint32_t SphereType = 0;
+	static constexpr uint32_t QuadType = 1;
+
+	// 64-bit FNV-1a
+	static uint64_t hash(std::string_view text)
+	{
+		uint64_t h = 0xcbf29ce484222325ULL;
+		for (char c : text)
+		{
+			h ^= (unsigned char)c;
+			h *= 0x100000001b3ULL;
+		}
+		return h;
+	}
+
+	/// <summary>
+	/// Writes scene, whose bvh must be built, to path. Returns false without writing if the scene
+	/// holds primitives the cache has no record for. Throws if the file cannot be written.
+	/// </summary>
+	static bool write(const std::string& path, uint64_t sourceHash, const Scene& scene)
+	{
+		const Bvh& bvh = *scene.bvh;
+		auto& prims = bvh.orderedPrimitives();
+		auto& order = bvh.linear().primitiveOrder();
+
+		std::vector<CachedPrimitive> records;
+		std::unordered_map<const Hittable*, uint32_t> primIndex;
+		records.reserve(prims.size());
+
+		for (const Hittable* prim : prims)
+		{
+			CachedPrimitive record{};
+
+			if (auto sphere = dynamic_cast<const Sphere*>(prim))
+			{
+				record.type = SphereType;
+				record.mat = sphere->mat;
+				putVec(record.data, sphere->center);
+				record.data[3] = sphere->radius;
+			}
+			else if (auto quad = dynamic_cast<const Quad*>(prim))
+			{
+				record.type = QuadType;
+				record.mat = quad->mat;
+				putVec(record.data, quad->Q);
+				putVec(record.data + 3, quad->u);
+				putVec(record.data + 6, quad->v);
+			}
+			else
+			{
+				return false;
+			}
+
+			record.listIndex = (uint32_t)order[records.size()];
+			primIndex[prim] = (uint32_t)records.size();
+			records.push_back(record);
+		}
+
+		std::vector<uint32_t> lights;
+		for (auto& light : scene.lights.objects())
+		{
+			auto it = primIndex.find(light.get());
+			if (it == primIndex.end())
+				return false;
+			lights.push_back(it->second);
+		}
+
+		SceneCacheHeader header{};
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.sourceHash = sourceHash;
+		header.materialSize = sizeof(Material);
+		header.lightSampler = (uint32_t)scene.lightSampler;
+		header.seed = scene.seed;
+		header.camera = toCached(scene.camera);
+
+		std::vector<char> bytes(sizeof(header));
+		const std::string& checkpoint = scene.camera.checkpointPath;
+		header.checkpointPath = append(bytes, checkpoint.data(), checkpoint.size());
+		header.materials = append(bytes, scene.materials.data(), scene.materials.size());
+		header.primitives = append(bytes, records.data(), records.size());
+		header.lights = append(bytes, lights.data(), lights.size());
+		header.nodes = append(bytes, bvh.linear().nodeData(), bvh.linear().nodeCount());
+		std::memcpy(bytes.data(), &header, sizeof(header));
+
+		// same write-then-rename as checkpoints, a reader never maps a half-written cache
+		std::string tempPath = path + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			out.write(bytes.data(), bytes.size());
+			if (!out.flush())
+				throw std::runtime_error("Cannot write scene cache " + tempPath);
+		}
+		std::filesystem::rename(tempPath, path);
+		return true;
+	}
+
+	/// <summary>
+	/// Fills scene from the cache at path. Returns false if there is no usable cache for sourceHash
+	/// there (missing, stale, from another build or damaged), in which case scene is untouched.
+	/// </summary>
+	static bool read(const std::string& path, uint64_t sourceHash, Scene& scene)
+	{
+		auto file = std::make_shared<MappedFile>(path);
+		if (!file->valid() || file->size() < sizeof(SceneCacheHeader))
+			return false;
+
+		SceneCacheHeader header;
+		std::memcpy(&header, file->data(), sizeof(header));
+
+		if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version
+			|| header.sourceHash != sourceHash || header.materialSize != sizeof(Material))
+			return false;
+
+		auto checkpoint = section<char>(*file, header.checkpointPath);
+		auto materials = section<Material>(*file, header.materials);
+		auto records = section<CachedPrimitive>(*file, header.primitives);
+		auto lights = section<uint32_t>(*file, header.lights);
+		auto nodes = section<BvhNode>(*file, header.nodes);
+
+		if (!checkpoint || !materials || !records || !lights || !nodes || header.nodes.count > INT32_MAX)
+			return false;
+
+		// traversal trusts the nodes blindly, so a damaged tree has to be a miss here
+		if (!validNodes(nodes, header.nodes.count, header.primitives.count))
+			return false;
+
+		Scene cached;
+		cached.camera = fromCached(header.camera);
+		cached.camera.checkpointPath.assign(checkpoint, header.checkpointPath.count);
+		cached.seed = header.seed;
+		cached.lightSampler = (LightSamplerType)header.lightSampler;
+		cached.materials = MaterialTable(materials, header.materials.count);
+
+		// primitives come in leaf order, the scene lists them in its own
+		std::vector<std::shared_ptr<Hittable>> prims;
+		std::vector<std::shared_ptr<Hittable>> listed(header.primitives.count);
+		std::vector<int> order;
+		prims.reserve(header.primitives.count);
+		order.reserve(header.primitives.count);
+
+		for (uint64_t i = 0; i < header.primitives.count; i++)
+		{
+			const CachedPrimitive& record = records[i];
+			if (record.mat >= cached.materials.size() || record.listIndex >= listed.size() || listed[record.listIndex])
+				return false;
+
+			if (record.type == SphereType)
+				prims.push_back(std::make_shared<Sphere>(getVec(record.data), record.data[3], record.mat));
+			else if (record.type == QuadType)
+				prims.push_back(std::make_shared<Quad>(getVec(record.data), getVec(record.data + 3), getVec(record.data + 6), record.mat));
+			else
+				return false;
+
+			listed[record.listIndex] = prims.back();
+			order.push_back((int)record.listIndex);
+		}
+
+		for (auto& prim : listed)
+			cached.hittables.add(prim);
+
+		for (uint64_t i = 0; i < header.lights.count; i++)
+		{
+			if (lights[i] >= prims.size())
+				return false;
+			cached.lights.add(prims[lights[i]]);
+		}
+
+		// the nodes stay in the mapping, which lives as long as the BVH holds on to file
+		cached.bvh = std::make_unique<Bvh>(cached.hittables, LinearBvh(nodes, (int)header.nodes.count, std::move(order), file));
+
+		scene = std::move(cached);
+		return true;
+	}
+
+private:
+	static constexpr char Magic[4] = { 'R', 'T', 'S', 'C' };
+	static constexpr uint32_t Version = 2;
+
+	/// <summary>
+	/// Whether count nodes form a tree LinearBvh can walk without leaving its arrays. Every
+	/// interior node needs a valid split axis and a second child after its first and inside the
+	/// array. Every node but the root must be the child of exactly one node that comes before it.
+	/// The tree must be shallow enough for the traversal stack, and the leaf ranges must cover
+	/// each of the primCount primitives exactly once.
+	/// </summary>
+	static bool validNodes(const BvhNode* nodes, uint64_t count, uint64_t primCount)
+	{
+		if (count == 0)
+			return primCount == 0;
+
+		std::vector<int> depth(count, -1);
+		std::vector<char> covered(primCount, 0);
+		uint64_t coveredCount = 0;
+		depth[0] = 0;
+
+		for (uint64_t i = 0; i < count; i++)
+		{
+			const BvhNode& node = nodes[i];
+			if (depth[i] < 0 || depth[i] >= LinearBvh::StackSize)
+				return false;
+
+			if (node.primCount > 0)
+			{
+				if ((uint64_t)node.offset + node.primCount > primCount)
+					return false;
+
+				for (uint64_t prim = node.offset; prim < (uint64_t)node.offset + node.primCount; prim++)
+				{
+					if (covered[prim])
+						return false;
+					covered[prim] = 1;
+				}
+				coveredCount += node.primCount;
+				continue;
+			}
+
+			if (node.axis > 2 || node.offset <= i + 1 || node.offset >= count || depth[i + 1] >= 0 || depth[node.offset] >= 0)
+				return false;
+
+			depth[i + 1] = depth[i] + 1;
+			depth[node.offset] = depth[i] + 1;
+		}
+		return coveredCount == primCount;
+	}
+
+	static void putVec(double* out, const Vec& v)
+	{
+		out[0] = v.x;
+		out[1] = v.y;
+		out[2] = v.z;
+	}
+
+	static Vec getVec(const double* in)
+	{
+		return Vec(in[0], in[1], in[2]);
+	}
+
+	// appends count elements at the next offset aligned for T (BvhNodes want 32 bytes)
+	template <typename T>
+	static CacheSection append(std::vector<char>& bytes, const T* data, size_t count)
+	{
+		size_t offset = (bytes.size() + alignof(T) - 1) / alignof(T) * alignof(T);
+		bytes.resize(offset + count * sizeof(T));
+		if (count > 0)
+			std::memcpy(bytes.data() + offset, data, count * sizeof(T));
+		return { offset, count };
+	}
+
+	// pointer to a section inside the mapping, nullptr if it does not fit or is misaligned
+	template <typename T>
+	static const T* section(const MappedFile& file, const CacheSection& s)
+	{
+		if (s.offset % alignof(T) != 0 || s.offset > file.size() || s.count > (file.size() - s.offset) / sizeof(T))
+			return nullptr;
+		return reinterpret_cast<const T*>(file.data() + s.offset);
+	}
+
+	static CachedCamera toCached(const CamParams& params)
+	{
+		CachedCamera c{};
+		c.aspectRatio = params.aspectRatio;
+		c.focalDist = params.focalDist;
+		c.defocusAngle = params.defocusAngle;
+		c.vFov = params.vFov;
+		putVec(c.pos, params.pos);
+		putVec(c.lookAt, params.lookAt);
+		putVec(c.upDir, params.upDir);
+		putVec(c.background, params.background);
+		c.rouletteMinSurvival = params.rouletteMinSurvival;
+		c.rouletteMaxSurvival = params.rouletteMaxSurvival;
+		c.adaptiveTargetError = params.adaptiveTargetError;
+		c.samplesPerPixel = params.samplesPerPixel;
+		c.maxDepth = params.maxDepth;
+		c.imgWidth = params.imgWidth;
+		c.threadCount = params.threadCount;
+		c.tileSize = params.tileSize;
+		c.rouletteDepth = params.rouletteDepth;
+		c.sampler = (int32_t)params.sampler;
+		c.adaptiveMinSpp = params.adaptiveMinSpp;
+		c.adaptiveMaxSpp = params.adaptiveMaxSpp;
+		c.progressivePassSpp = params.progressivePassSpp;
+		c.processCount = params.processCount;
+		return c;
+	}
+
+	static CamParams fromCached(const CachedCamera& c)
+	{
+		CamParams params;
+		params.aspectRatio = c.aspectRatio;
+		params.focalDist = c.focalDist;
+		params.defocusAngle = c.defocusAngle;
+		params.vFov = c.vFov;
+		params.pos = getVec(c.pos);
+		params.lookAt = getVec(c.lookAt);
+		params.upDir = getVec(c.upDir);
+		params.background = getVec(c.background);
+		params.rouletteMinSurvival = c.rouletteMinSurvival;
+		params.rouletteMaxSurvival = c.rouletteMaxSurvival;
+		params.adaptiveTargetError = c.adaptiveTargetError;
+		params.samplesPerPixel = c.samplesPerPixel;
+		params.maxDepth = c.maxDepth;
+		params.imgWidth = c.imgWidth;
+		params.threadCount = c.threadCount;
+		params.tileSize = c.tileSize;
+		params.rouletteDepth = c.rouletteDepth;
+		params.sampler = (SamplerType)c.sampler;
+		params.adaptiveMinSpp = c.adaptiveMinSpp;
+		params.adaptiveMaxSpp = c.adaptiveMaxSpp;
+		params.progressivePassSpp = c.progressivePassSpp;
+		params.processCount = c.processCount;
+		return params;
+	}
+};
+
+/// <summary>
+/// Loads the scene file at path with its BVH. With useCache, a cache next to it (path + ".cache")
+/// is used when it matches the file's contents, and written after parsing when it does not.
+/// A cache that cannot be written only costs the next run its head start, so that is not an error.
+/// </summary>
+inline Scene loadScene(const std::string& path, bool useCache = true)
+{
+	MappedFile file(path);
+	if (!file.valid() && !std::filesystem::exists(path))
+		throw std::runtime_error("Cannot open scene file " + path);
+
+	std::string_view text(file.data() ? file.data() : "", file.size());
+	uint64_t sourceHash = SceneCache::hash(text);
+	std::string cachePath = path + ".cache";
+
+	Scene scene;
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (useCache && SceneCache::read(cachePath, sourceHash, scene))
+	{
+		auto stop = std::chrono::high_resolution_clock::now();
+		std::cout << "Scene cache: " << scene.bvh->nodeCount() << " BVH nodes mapped from " << cachePath << " in "
+			<< std::chrono::duration<double, std::milli>(stop - start).count() << " ms" << std::endl;
+		return scene;
+	}
+
+	scene = SceneParser::parse(text, path);
+
+	auto parsed = std::chrono::high_resolution_clock::now();
+	std::cout << "Scene parsed in " << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms" << std::endl;
+
+	scene.bvh = std::make_unique<Bvh>(scene.hittables);
+	std::cout << "BVH: " << scene.bvh->nodeCount() << " nodes built in " << scene.bvh->buildMilliseconds() << " ms" << std::endl;
+
+	if (useCache)
+	{
+		try
+		{
+			if (!SceneCache::write(cachePath, sourceHash, scene))
+				std::cout << "Scene has primitives the scene cache cannot store, not cached" << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << e.what() << std::endl;
+		}
+	}
+
+	return scene;
+}
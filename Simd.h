@@ -0,0 +1,68 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RAYTRACING_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only emit AVX2 instructions in functions marked for it, the build targets the
+// baseline ISA. SIMD_AVX2 marks kernels; SIMD_AVX2_ENTRY marks the function a dispatch jumps to
+// and inlines everything it calls into it, so generic traversal templates compile as AVX2 too.
+// MSVC allows the intrinsics anywhere.
+#if defined(RAYTRACING_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_AVX2 __attribute__((target("avx2")))
+#define SIMD_AVX2_ENTRY __attribute__((target("avx2"), flatten))
+#else
+#define SIMD_AVX2
+#define SIMD_AVX2_ENTRY
+#endif
+
+enum class SimdLevel
+{
+	Scalar,
+	Sse, // SSE2, always there on x86-64
+	Avx2
+};
+
+/// <summary>
+/// Widest instruction set this CPU and OS can run, checked once. Code paths compiled for a level
+/// must only be entered when this returns at least that level.
+/// </summary>
+inline SimdLevel detectSimd()
+{
+	static const SimdLevel level = []()
+	{
+#if !defined(RAYTRACING_X86)
+		return SimdLevel::Scalar;
+#elif defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 1);
+		bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, XMM and YMM state
+		if (!(info[3] & (1 << 26)))
+			return SimdLevel::Scalar;
+
+		__cpuidex(info, 7, 0);
+		return osSavesYmm && (info[1] & (1 << 5)) ? SimdLevel::Avx2 : SimdLevel::Sse;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return SimdLevel::Avx2;
+		return __builtin_cpu_supports("sse2") ? SimdLevel::Sse : SimdLevel::Scalar;
+#endif
+	}();
+
+	return level;
+}
+
+inline const char* simdName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Avx2: return "AVX2";
+	case SimdLevel::Sse: return "SSE2";
+	default: return "scalar";
+	}
+}
@@ -1,12 +1,13 @@
 #pragma once
 #include "Hittable.h"
 #include <iostream>
+#include "Onb.h"
 #include "Material.h"
 
 class Sphere : public Hittable
 {
 	public:
-		Sphere(const Point& center_, double radius_, const std::shared_ptr<Material>& mat)
+		Sphere(const Point& center_, double radius_, MaterialId mat)
 			: center(center_), radius(radius_), mat(mat)
 		{
 
@@ -14,44 +15,36 @@ class Sphere : public Hittable
 
 		bool hit(const Ray& ray, const Interval& interval, Hit& hit) const override
 		{
-			auto& d = ray.dir();
-			auto& q = ray.origin();
+			double t;
 
-			auto a = glm::dot(d, d);
-
-			auto qc = q - center;
-			auto b = 2.0f * glm::dot(d, qc);
-			auto c = glm::dot(qc, qc) - radius * radius;
-
-			auto discriminant = (b * b - 4.0f * a * c);
-			
-			if (discriminant < 0)
+			if (!intersect(ray, interval, t))
 				return false;
 
-			auto t = ( - b - sqrt(discriminant)) / 2 / a;
-
-			if (!interval.surrounds(t))
-			{
-				t = (-b + sqrt(discriminant)) / 2 / a;
-
-				if (!interval.surrounds(t))
-					return false;
-			}
-
 			hit.t = t;
 			hit.pos = ray.at(hit.t);
 			hit.mat = mat;
+			hit.object = this;
 		    auto outNorm = glm::normalize(hit.pos - center);
 
 			hit.setFaceNormal(ray, outNorm);
 
 			return true;
 		}
-		double pdf(const Point& origin, const Point& dir) const override
+
+		bool occluded(const Ray& ray, const Interval& interval) const override
 		{
-			Hit hitpt;
+			double t;
+			return intersect(ray, interval, t);
+		}
 
-			if (!hit(Ray(origin, dir), Interval(0.001, std::numeric_limits<double>::max()), hitpt))
+		Aabb boundingBox() const override
+		{
+			return Aabb(center - Vec(radius), center + Vec(radius));
+		}
+
+		double pdf(const Point& origin, const Point& dir) const override
+		{
+			if (!occluded(Ray(origin, dir), Interval(0.001, std::numeric_limits<double>::max())))
 				return 0;
 
 			double height = glm::length(center - origin);
@@ -61,17 +54,70 @@ class Sphere : public Hittable
 			return 1 / (2 * pi * (1 - cosMax));
 		}
 
-		Vec randomSample(Random& rand, const Point& origin) const override
+		Vec randomSample(Sampler& sampler, const Point& origin) const override
 		{
 			Vec toSphere = center - origin;
 			double d = glm::length(toSphere);
-			Vec dir = rand.sampleCone(radius, d);
+			Vec dir = sampler.sampleCone(radius, d);
 			Onb onb(glm::normalize(toSphere));
 			return glm::normalize(onb.localToWorld(dir));
 		}
 
+		double power(const MaterialTable& materials) const override
+		{
+			return 4 * pi * radius * radius * pi * luminance(materials[mat].emission());
+		}
+
+		LightBounds lightBounds(const MaterialTable& materials) const override
+		{
+			// emits in every direction
+			return LightBounds(boundingBox(), Vec(0, 0, 1), power(materials), -1, 0);
+		}
+
+		const Point& centerPoint() const { return center; }
+		double radiusLength() const { return radius; }
+		MaterialId material() const { return mat; }
+
+		// for animation; a Bvh holding the sphere needs an update() before the next render
+		void moveTo(const Point& newCenter)
+		{
+			center = newCenter;
+		}
+
 	private:
+		friend class SceneCache;
+
 		Point center;
 		double radius;
-		std::shared_ptr<Material> mat;
+		MaterialId mat;
+
+		bool intersect(const Ray& ray, const Interval& interval, double& tHit) const
+		{
+			auto& d = ray.dir();
+			auto& q = ray.origin();
+
+			auto a = glm::dot(d, d);
+
+			auto qc = q - center;
+			auto b = 2.0f * glm::dot(d, qc);
+			auto c = glm::dot(qc, qc) - radius * radius;
+
+			auto discriminant = (b * b - 4.0f * a * c);
+			
+			if (discriminant < 0)
+				return false;
+
+			auto t = ( - b - sqrt(discriminant)) / 2 / a;
+
+			if (!interval.surrounds(t))
+			{
+				t = (-b + sqrt(discriminant)) / 2 / a;
+
+				if (!interval.surrounds(t))
+					return false;
+			}
+
+			tHit = t;
+			return true;
+		}
 };
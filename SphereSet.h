@@ -0,0 +1,359 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "HittableList.h"
+#include "LinearBvh.h"
+#include "Simd.h"
+#include "Sphere.h"
+
+/// <summary>
+/// A small group of spheres intersected together. Centers, radii and materials are kept as
+/// structure of arrays, so one ray is tested against 4 spheres per instruction with AVX2 and 2 with
+/// SSE2 instead of one virtual Sphere::hit per sphere. The math is Sphere's, in double and in the
+/// same order, so a set hits exactly where its spheres would; equal distances go to the sphere that
+/// comes first, as in a HittableList.
+///
+/// Meant for the scene BVH to hold instead of the spheres, see group(). The set is never a light
+/// itself, pdf and sampling go to its spheres for completeness.
+/// </summary>
+class SphereSet : public Hittable
+{
+public:
+	// arrays are padded to a whole number of the widest registers, 4 doubles
+	static constexpr int Lanes = 4;
+
+	explicit SphereSet(std::vector<std::shared_ptr<Sphere>> members, SimdLevel simd = detectSimd())
+		: spheres(std::move(members)), kernel(simd)
+	{
+		size_t padded = (spheres.size() + Lanes - 1) / Lanes * Lanes;
+
+		// NaN centers make padding lanes fail every comparison
+		double nan = std::numeric_limits<double>::quiet_NaN();
+		centerX.assign(padded, nan);
+		centerY.assign(padded, nan);
+		centerZ.assign(padded, nan);
+		radius.assign(padded, 0);
+
+		for (size_t i = 0; i < spheres.size(); i++)
+		{
+			const Point& center = spheres[i]->centerPoint();
+			centerX[i] = center.x;
+			centerY[i] = center.y;
+			centerZ[i] = center.z;
+			radius[i] = spheres[i]->radiusLength();
+			materials.push_back(spheres[i]->material());
+			box.grow(spheres[i]->boundingBox());
+		}
+	}
+
+	/// <summary>
+	/// hittables with every sphere that is not in lights moved into SphereSets of up to groupSize.
+	/// A set is the largest subtree of a BVH over the spheres that fits, so it holds neighbours and
+	/// the scene BVH built over the sets keeps the upper levels of that tree. Everything else is kept
+	/// as it is.
+	/// </summary>
+	static HittableList group(const HittableList& hittables, const HittableList& lights, int groupSize = 16)
+	{
+		HittableList result;
+		std::vector<std::shared_ptr<Sphere>> loose;
+		std::vector<Aabb> bounds;
+		std::unordered_set<const Hittable*> lightSet;
+		for (auto& light : lights.objects())
+			lightSet.insert(light.get());
+
+		for (auto& hittable : hittables.objects())
+		{
+			auto sphere = std::dynamic_pointer_cast<Sphere>(hittable);
+			if (sphere && !lightSet.count(sphere.get()))
+			{
+				loose.push_back(sphere);
+				bounds.push_back(sphere->boundingBox());
+			}
+			else
+			{
+				result.add(hittable);
+			}
+		}
+
+		if (loose.empty())
+			return result;
+
+		LinearBvh tree(bounds);
+		const BvhNode* nodes = tree.nodeData();
+		std::vector<int> stack = { 0 };
+
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+
+			int first, count;
+			tree.subtreePrimitives(index, first, count);
+			if (count > groupSize && nodes[index].primCount == 0)
+			{
+				stack.push_back(nodes[index].offset);
+				stack.push_back(index + 1);
+				continue;
+			}
+
+			std::vector<std::shared_ptr<Sphere>> members;
+			for (int i = first; i < first + count; i++)
+				members.push_back(loose[tree.primitiveOrder()[i]]);
+
+			result.add(std::make_shared<SphereSet>(std::move(members)));
+		}
+		return result;
+	}
+
+	bool hit(const Ray& ray, const Interval& interval, Hit& hit) const override
+	{
+		double t;
+		int index = nearest(ray, interval, t);
+		if (index < 0)
+			return false;
+
+		hit.t = t;
+		hit.pos = ray.at(hit.t);
+		hit.mat = materials[index];
+		hit.object = this;
+		auto outNorm = glm::normalize(hit.pos - Point(centerX[index], centerY[index], centerZ[index]));
+
+		hit.setFaceNormal(ray, outNorm);
+
+		return true;
+	}
+
+	bool occluded(const Ray& ray, const Interval& interval) const override
+	{
+		double t;
+		return nearest(ray, interval, t, true) >= 0;
+	}
+
+	Aabb boundingBox() const override
+	{
+		return box;
+	}
+
+	double pdf(const Point& origin, const Point& dir) const override
+	{
+		double sum = 0;
+		for (auto& sphere : spheres)
+			sum += sphere->pdf(origin, dir);
+		return sum / spheres.size();
+	}
+
+	Vec randomSample(Sampler& sampler, const Point& origin) const override
+	{
+		int len = (int)spheres.size();
+		int index = std::min((int)(sampler.get1D() * len), len - 1);
+		return spheres[index]->randomSample(sampler, origin);
+	}
+
+	double power(const MaterialTable& materials) const override
+	{
+		double sum = 0;
+		for (auto& sphere : spheres)
+			sum += sphere->power(materials);
+		return sum;
+	}
+
+	LightBounds lightBounds(const MaterialTable& materials) const override
+	{
+		LightBounds bounds;
+		for (auto& sphere : spheres)
+			bounds = LightBounds::merge(bounds, sphere->lightBounds(materials));
+		return bounds;
+	}
+
+	size_t size() const { return spheres.size(); }
+	SimdLevel simdLevel() const { return kernel; }
+
+private:
+	std::vector<std::shared_ptr<Sphere>> spheres; // for the light queries, hit and occluded only read the arrays
+	std::vector<double> centerX, centerY, centerZ, radius;
+	std::vector<MaterialId> materials;
+	Aabb box;
+	SimdLevel kernel;
+
+	// index of the sphere hit first within interval and its distance, -1 if none; any stops at the first one found
+	int nearest(const Ray& ray, const Interval& interval, double& tHit, bool any = false) const
+	{
+#ifdef RAYTRACING_X86
+		if (kernel == SimdLevel::Avx2)
+			return nearestAvx2(ray, interval, tHit, any);
+		if (kernel == SimdLevel::Sse)
+			return nearestSse(ray, interval, tHit, any);
+#endif
+		return nearestScalar(ray, interval, tHit, any);
+	}
+
+	int nearestScalar(const Ray& ray, const Interval& interval, double& tHit, bool any) const
+	{
+		auto& d = ray.dir();
+		auto& q = ray.origin();
+		auto a = glm::dot(d, d);
+
+		int best = -1;
+		tHit = interval.max;
+
+		for (int i = 0; i < (int)spheres.size(); i++)
+		{
+			auto qc = q - Point(centerX[i], centerY[i], centerZ[i]);
+			auto b = 2.0 * glm::dot(d, qc);
+			auto c = glm::dot(qc, qc) - radius[i] * radius[i];
+
+			auto discriminant = (b * b - 4.0 * a * c);
+			if (discriminant < 0)
+				continue;
+
+			auto t = (-b - sqrt(discriminant)) / 2 / a;
+			if (!(interval.min < t && t < tHit))
+			{
+				t = (-b + sqrt(discriminant)) / 2 / a;
+				if (!(interval.min < t && t < tHit))
+					continue;
+			}
+
+			tHit = t;
+			best = i;
+			if (any)
+				break;
+		}
+		return best;
+	}
+
+	// lowest t over the lanes, the lower index on ties; -1 if no lane holds a hit
+	template <int Count>
+	static int reduce(const double* t, const double* index, double& tHit)
+	{
+		int best = -1;
+		for (int lane = 0; lane < Count; lane++)
+		{
+			if (index[lane] >= 0 && (best < 0 || t[lane] < tHit || (t[lane] == tHit && index[lane] < best)))
+			{
+				tHit = t[lane];
+				best = (int)index[lane];
+			}
+		}
+		return best;
+	}
+
+#ifdef RAYTRACING_X86
+	int nearestSse(const Ray& ray, const Interval& interval, double& tHit, bool any) const
+	{
+		auto& d = ray.dir();
+		auto& q = ray.origin();
+		double a = glm::dot(d, d);
+
+		__m128d dx = _mm_set1_pd(d.x), dy = _mm_set1_pd(d.y), dz = _mm_set1_pd(d.z);
+		__m128d qx = _mm_set1_pd(q.x), qy = _mm_set1_pd(q.y), qz = _mm_set1_pd(q.z);
+		__m128d two = _mm_set1_pd(2.0), fourA = _mm_set1_pd(4.0 * a), twoA = _mm_set1_pd(2.0 * a);
+		__m128d tMin = _mm_set1_pd(interval.min), zero = _mm_setzero_pd();
+
+		__m128d bestT = _mm_set1_pd(interval.max);
+		__m128d bestIndex = _mm_set1_pd(-1);
+		__m128d laneOffset = _mm_set_pd(1, 0);
+
+		for (size_t i = 0; i < centerX.size(); i += 2)
+		{
+			__m128d qcx = _mm_sub_pd(qx, _mm_loadu_pd(&centerX[i]));
+			__m128d qcy = _mm_sub_pd(qy, _mm_loadu_pd(&centerY[i]));
+			__m128d qcz = _mm_sub_pd(qz, _mm_loadu_pd(&centerZ[i]));
+			__m128d r = _mm_loadu_pd(&radius[i]);
+
+			__m128d b = _mm_mul_pd(two, _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, qcx), _mm_mul_pd(dy, qcy)), _mm_mul_pd(dz, qcz)));
+			__m128d c = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(qcx, qcx), _mm_mul_pd(qcy, qcy)), _mm_mul_pd(qcz, qcz)), _mm_mul_pd(r, r));
+			__m128d discriminant = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(fourA, c));
+			__m128d real = _mm_cmpge_pd(discriminant, zero);
+			if (!_mm_movemask_pd(real))
+				continue;
+
+			__m128d root = _mm_sqrt_pd(discriminant);
+			__m128d minusB = _mm_sub_pd(zero, b);
+			__m128d t0 = _mm_div_pd(_mm_sub_pd(minusB, root), twoA);
+			__m128d t1 = _mm_div_pd(_mm_add_pd(minusB, root), twoA);
+
+			__m128d in0 = _mm_and_pd(_mm_cmplt_pd(tMin, t0), _mm_cmplt_pd(t0, bestT));
+			__m128d in1 = _mm_and_pd(_mm_cmplt_pd(tMin, t1), _mm_cmplt_pd(t1, bestT));
+			__m128d t = _mm_or_pd(_mm_and_pd(in0, t0), _mm_andnot_pd(in0, t1));
+			__m128d closer = _mm_and_pd(real, _mm_or_pd(in0, in1));
+
+			int mask = _mm_movemask_pd(closer);
+			if (mask)
+			{
+				bestT = _mm_or_pd(_mm_and_pd(closer, t), _mm_andnot_pd(closer, bestT));
+				__m128d index = _mm_add_pd(_mm_set1_pd((double)i), laneOffset);
+				bestIndex = _mm_or_pd(_mm_and_pd(closer, index), _mm_andnot_pd(closer, bestIndex));
+				if (any)
+					break;
+			}
+		}
+
+		alignas(16) double t[2], lanes[2];
+		_mm_store_pd(t, bestT);
+		_mm_store_pd(lanes, bestIndex);
+		return reduce<2>(t, lanes, tHit);
+	}
+
+	SIMD_AVX2 int nearestAvx2(const Ray& ray, const Interval& interval, double& tHit, bool any) const
+	{
+		auto& d = ray.dir();
+		auto& q = ray.origin();
+		double a = glm::dot(d, d);
+
+		__m256d dx = _mm256_set1_pd(d.x), dy = _mm256_set1_pd(d.y), dz = _mm256_set1_pd(d.z);
+		__m256d qx = _mm256_set1_pd(q.x), qy = _mm256_set1_pd(q.y), qz = _mm256_set1_pd(q.z);
+		__m256d two = _mm256_set1_pd(2.0), fourA = _mm256_set1_pd(4.0 * a), twoA = _mm256_set1_pd(2.0 * a);
+		__m256d tMin = _mm256_set1_pd(interval.min), zero = _mm256_setzero_pd();
+
+		__m256d bestT = _mm256_set1_pd(interval.max);
+		__m256d bestIndex = _mm256_set1_pd(-1);
+		__m256d laneOffset = _mm256_set_pd(3, 2, 1, 0);
+
+		for (size_t i = 0; i < centerX.size(); i += Lanes)
+		{
+			__m256d qcx = _mm256_sub_pd(qx, _mm256_loadu_pd(&centerX[i]));
+			__m256d qcy = _mm256_sub_pd(qy, _mm256_loadu_pd(&centerY[i]));
+			__m256d qcz = _mm256_sub_pd(qz, _mm256_loadu_pd(&centerZ[i]));
+			__m256d r = _mm256_loadu_pd(&radius[i]);
+
+			// written out without fused multiply-adds so every lane rounds like Sphere::hit
+			__m256d b = _mm256_mul_pd(two, _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, qcx), _mm256_mul_pd(dy, qcy)), _mm256_mul_pd(dz, qcz)));
+			__m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(qcx, qcx), _mm256_mul_pd(qcy, qcy)), _mm256_mul_pd(qcz, qcz)), _mm256_mul_pd(r, r));
+			__m256d discriminant = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(fourA, c));
+			__m256d real = _mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ);
+			if (!_mm256_movemask_pd(real))
+				continue;
+
+			__m256d root = _mm256_sqrt_pd(discriminant);
+			__m256d minusB = _mm256_sub_pd(zero, b);
+			__m256d t0 = _mm256_div_pd(_mm256_sub_pd(minusB, root), twoA);
+			__m256d t1 = _mm256_div_pd(_mm256_add_pd(minusB, root), twoA);
+
+			__m256d in0 = _mm256_and_pd(_mm256_cmp_pd(tMin, t0, _CMP_LT_OQ), _mm256_cmp_pd(t0, bestT, _CMP_LT_OQ));
+			__m256d in1 = _mm256_and_pd(_mm256_cmp_pd(tMin, t1, _CMP_LT_OQ), _mm256_cmp_pd(t1, bestT, _CMP_LT_OQ));
+			__m256d t = _mm256_blendv_pd(t1, t0, in0);
+			__m256d closer = _mm256_and_pd(real, _mm256_or_pd(in0, in1));
+
+			if (_mm256_movemask_pd(closer))
+			{
+				bestT = _mm256_blendv_pd(bestT, t, closer);
+				__m256d index = _mm256_add_pd(_mm256_set1_pd((double)i), laneOffset);
+				bestIndex = _mm256_blendv_pd(bestIndex, index, closer);
+				if (any)
+					break;
+			}
+		}
+
+		alignas(32) double t[4], lanes[4];
+		_mm256_store_pd(t, bestT);
+		_mm256_store_pd(lanes, bestIndex);
+		return reduce<4>(t, lanes, tHit);
+	}
+#endif
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Runs a batch of independent tasks over a set of worker threads with work stealing.
+/// Every worker owns a queue of task indices. It pops from the back of its own queue and,
+/// once that runs dry, steals from the front of the other queues, so expensive tasks
+/// (tiles full of glass) and cheap ones (tiles of background) even out across workers.
+/// </summary>
+class ThreadPool
+{
+public:
+	// threadCount <= 0 means one worker per hardware thread
+	explicit ThreadPool(int threadCount)
+	{
+		if (threadCount <= 0)
+			threadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+
+		workerCount = threadCount;
+	}
+
+	int size() const { return workerCount; }
+
+	/// <summary>
+	/// Calls fn(taskIndex, workerIndex) once for every task index in [0, taskCount) and returns
+	/// when all of them are done. The calling thread takes part as worker 0.
+	/// </summary>
+	template <typename Fn>
+	void parallelFor(int taskCount, Fn&& fn)
+	{
+		int workers = std::max(1, std::min(workerCount, taskCount));
+		std::vector<WorkQueue> queues(workers);
+
+		// deal tasks round robin so neighbouring (similarly expensive) tasks start on different workers
+		for (int task = 0; task < taskCount; task++)
+			queues[task % workers].tasks.push_back(task);
+
+		std::exception_ptr error;
+		std::mutex errorMutex;
+
+		auto work = [&](int worker)
+		{
+			int task;
+			while (pop(queues, worker, task) || steal(queues, worker, task))
+			{
+				try
+				{
+					fn(task, worker);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(errorMutex);
+					if (!error)
+						error = std::current_exception();
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(workers - 1);
+
+		for (int worker = 1; worker < workers; worker++)
+			threads.emplace_back(work, worker);
+
+		work(0);
+
+		for (auto& thread : threads)
+			thread.join();
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+private:
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<int> tasks;
+	};
+
+	int workerCount;
+
+	static bool pop(std::vector<WorkQueue>& queues, int worker, int& task)
+	{
+		auto& queue = queues[worker];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.tasks.empty())
+			return false;
+
+		task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	static bool steal(std::vector<WorkQueue>& queues, int thief, int& task)
+	{
+		int count = (int)queues.size();
+
+		for (int i = 1; i < count; i++)
+		{
+			auto& victim = queues[(thief + i) % count];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (victim.tasks.empty())
+				continue;
+
+			task = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+};
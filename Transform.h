@@ -0,0 +1,111 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#include "Aabb.h"
+#include "RayTracing.h"
+
+/// <summary>
+/// Affine object-to-world transform: a linear part and a translation, with the inverse of the
+/// linear part kept alongside so world-to-object needs no inversion per ray.
+/// </summary>
+class Transform
+{
+public:
+	// identity
+	Transform() = default;
+
+	Transform(const glm::dmat3& linear, const Vec& translation)
+		: linear(linear), inverseLinear(glm::inverse(linear)), translation(translation)
+	{
+	}
+
+	static Transform translate(const Vec& offset)
+	{
+		return Transform(glm::dmat3(1.0), offset);
+	}
+
+	static Transform scale(const Vec& factors)
+	{
+		return Transform(glm::dmat3(Vec(factors.x, 0, 0), Vec(0, factors.y, 0), Vec(0, 0, factors.z)), Vec(0, 0, 0));
+	}
+
+	// counter-clockwise by degrees around axis, looking down the axis toward the origin
+	static Transform rotate(const Vec& axis, double degrees)
+	{
+		Vec a = glm::normalize(axis);
+		double c = std::cos(degToRad(degrees));
+		double s = std::sin(degToRad(degrees));
+		double k = 1 - c;
+
+		// Rodrigues' formula, column by column
+		glm::dmat3 m(
+			Vec(c + a.x * a.x * k, a.y * a.x * k + a.z * s, a.z * a.x * k - a.y * s),
+			Vec(a.x * a.y * k - a.z * s, c + a.y * a.y * k, a.z * a.y * k + a.x * s),
+			Vec(a.x * a.z * k + a.y * s, a.y * a.z * k - a.x * s, c + a.z * a.z * k));
+
+		return Transform(m, Vec(0, 0, 0));
+	}
+
+	// other first, then this
+	Transform operator*(const Transform& other) const
+	{
+		return Transform(linear * other.linear, linear * other.translation + translation);
+	}
+
+	Point point(const Point& p) const { return linear * p + translation; }
+	Vec vector(const Vec& v) const { return linear * v; }
+	// normals go through the inverse transpose to stay perpendicular to transformed surfaces
+	Vec normal(const Vec& n) const { return glm::transpose(inverseLinear) * n; }
+
+	Point inversePoint(const Point& p) const { return inverseLinear * (p - translation); }
+	Vec inverseVector(const Vec& v) const { return inverseLinear * v; }
+
+	double determinant() const { return glm::determinant(linear); }
+
+	// scales every length by the same factor, so angles and solid angles survive
+	bool isSimilarity() const
+	{
+		glm::dmat3 gram = glm::transpose(linear) * linear;
+		double scale2 = gram[0][0];
+
+		for (int col = 0; col < 3; col++)
+		{
+			for (int row = 0; row < 3; row++)
+			{
+				if (std::fabs(gram[col][row] - (col == row ? scale2 : 0)) > 1e-9 * scale2)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Tight box around the transformed box (Arvo): each output axis takes, per input axis, the
+	/// smaller and larger of the scaled min and max.
+	/// </summary>
+	Aabb bounds(const Aabb& box) const
+	{
+		if (box.empty())
+			return box;
+
+		Aabb result(translation, translation);
+
+		for (int row = 0; row < 3; row++)
+		{
+			for (int col = 0; col < 3; col++)
+			{
+				double a = linear[col][row] * box.min[col];
+				double b = linear[col][row] * box.max[col];
+				result.min[row] += std::min(a, b);
+				result.max[row] += std::max(a, b);
+			}
+		}
+		return result;
+	}
+
+private:
+	glm::dmat3 linear = glm::dmat3(1.0);
+	glm::dmat3 inverseLinear = glm::dmat3(1.0);
+	Vec translation = Vec(0, 0, 0);
+};
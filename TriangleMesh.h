@@ -0,0 +1,327 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "Bvh.h"
+#include "Hittable.h"
+#include "Material.h"
+
+/// <summary>
+/// Indexed triangle mesh: vertex positions, optional per-vertex normals and three indices per
+/// triangle, each in one flat array for the whole mesh, plus a BVH of its own over the triangles.
+/// To the scene it is a single Hittable, so it goes into a HittableList or a scene Bvh like any
+/// sphere. Triangles face the side their counter-clockwise winding (p0, p1, p2) points to.
+///
+/// As a light it is sampled by area: a triangle in proportion to its area, then a uniform point
+/// on it. Emission still comes from each triangle's material, so only emitting triangles add power.
+/// </summary>
+class TriangleMesh : public Hittable
+{
+public:
+	/// <summary>
+	/// normals is empty or holds one normal per position, interpolated across each triangle for
+	/// shading. triangleMaterials is empty (every triangle uses mat) or holds one id per triangle.
+	/// </summary>
+	TriangleMesh(std::vector<Point> positions, std::vector<uint32_t> indices, MaterialId mat,
+		std::vector<Vec> normals = {}, std::vector<MaterialId> triangleMaterials = {})
+		: positions(std::move(positions)), normals(std::move(normals)), mat(mat)
+	{
+		if (indices.size() % 3 != 0)
+			throw std::invalid_argument("Triangle mesh index count is not a multiple of 3");
+
+		if (!this->normals.empty() && this->normals.size() != this->positions.size())
+			throw std::invalid_argument("Triangle mesh needs one normal per position or none");
+
+		size_t count = indices.size() / 3;
+
+		if (!triangleMaterials.empty() && triangleMaterials.size() != count)
+			throw std::invalid_argument("Triangle mesh needs one material per triangle or none");
+
+		for (uint32_t index : indices)
+		{
+			if (index >= this->positions.size())
+				throw std::out_of_range("Triangle mesh index out of range");
+		}
+
+		std::vector<Aabb> bounds;
+		bounds.reserve(count);
+
+		for (size_t tri = 0; tri < count; tri++)
+		{
+			Aabb box(this->positions[indices[3 * tri]], this->positions[indices[3 * tri + 1]]);
+			box.grow(this->positions[indices[3 * tri + 2]]);
+			box.pad(1e-4);
+			bounds.push_back(box);
+			meshBounds.grow(box);
+		}
+
+		bvh = LinearBvh(bounds);
+
+		// leaves index triangles directly, so store them in leaf order
+		this->indices.reserve(indices.size());
+		if (!triangleMaterials.empty())
+			this->triangleMaterials.reserve(count);
+
+		for (int tri : bvh.primitiveOrder())
+		{
+			this->indices.insert(this->indices.end(), indices.begin() + 3 * tri, indices.begin() + 3 * tri + 3);
+			if (!triangleMaterials.empty())
+				this->triangleMaterials.push_back(triangleMaterials[tri]);
+		}
+
+		areaCdf.reserve(count);
+		for (size_t tri = 0; tri < count; tri++)
+		{
+			totalArea += triangleArea((int)tri);
+			areaCdf.push_back(totalArea);
+		}
+	}
+
+	bool hit(const Ray& ray, const Interval& interval, Hit& hit) const override
+	{
+		RayTransform transform(ray);
+		double closestHit = interval.max;
+		int hitTriangle = -1;
+		double b0 = 0, b1 = 0, b2 = 0;
+		long long visits = 0;
+
+		bvh.traverse(ray, interval.min, closestHit, [&](int tri, double tMin, double& closest)
+		{
+			double t, u, v, w;
+			if (!intersect(tri, ray, transform, Interval(tMin, closest), t, u, v, w))
+				return false;
+
+			closest = t;
+			hitTriangle = tri;
+			b0 = u;
+			b1 = v;
+			b2 = w;
+			return true;
+		}, visits);
+
+		if (hitTriangle < 0)
+			return false;
+
+		const uint32_t* idx = &indices[3 * hitTriangle];
+		Vec geometricNormal = glm::normalize(glm::cross(positions[idx[1]] - positions[idx[0]], positions[idx[2]] - positions[idx[0]]));
+
+		hit.t = closestHit;
+		hit.pos = ray.at(closestHit);
+		hit.mat = materialOf(hitTriangle);
+		hit.object = this;
+		hit.frontface = glm::dot(ray.dir(), geometricNormal) < 0;
+
+		Vec normal = geometricNormal;
+		if (!normals.empty())
+		{
+			Vec shading = b0 * normals[idx[0]] + b1 * normals[idx[1]] + b2 * normals[idx[2]];
+			if (glm::dot(shading, shading) > 0)
+			{
+				// keep shading normals on the geometric side, front and back stay decided by the winding
+				shading = glm::normalize(shading);
+				normal = glm::dot(shading, geometricNormal) < 0 ? -shading : shading;
+			}
+		}
+
+		hit.normal = hit.frontface ? normal : -normal;
+		return true;
+	}
+
+	bool occluded(const Ray& ray, const Interval& interval) const override
+	{
+		RayTransform transform(ray);
+		long long visits = 0;
+
+		return bvh.traverseAny(ray, interval.min, interval.max, [&](int tri)
+		{
+			double t, u, v, w;
+			return intersect(tri, ray, transform, interval, t, u, v, w);
+		}, visits);
+	}
+
+	Aabb boundingBox() const override
+	{
+		return meshBounds;
+	}
+
+	/// <summary>
+	/// Solid angle density of randomSample's directions. A ray can cross the mesh several times
+	/// and randomSample may have picked any of those points, so their densities add up.
+	/// </summary>
+	double pdf(const Point& origin, const Point& dir) const override
+	{
+		if (totalArea <= 0)
+			return 0;
+
+		Ray ray(origin, dir);
+		RayTransform transform(ray);
+		double tMax = std::numeric_limits<double>::max();
+		double density = 0;
+		long long visits = 0;
+
+		bvh.traverse(ray, 0.001, tMax, [&](int tri, double tMin, double& closest)
+		{
+			double t, u, v, w;
+			if (!intersect(tri, ray, transform, Interval(tMin, closest), t, u, v, w))
+				return false;
+
+			const uint32_t* idx = &indices[3 * tri];
+			Vec n = glm::cross(positions[idx[1]] - positions[idx[0]], positions[idx[2]] - positions[idx[0]]);
+			double cosine = std::fabs(glm::dot(ray.dir(), n)) / glm::length(n);
+
+			if (cosine > 0)
+				density += t * t / cosine;
+			return false;
+		}, visits);
+
+		return density / totalArea;
+	}
+
+	Vec randomSample(Sampler& sampler, const Point& origin) const override
+	{
+		double u = sampler.get1D() * totalArea;
+		int tri = (int)(std::upper_bound(areaCdf.begin(), areaCdf.end(), u) - areaCdf.begin());
+		tri = std::min(tri, (int)areaCdf.size() - 1);
+
+		// uniform over the triangle
+		Point2 uv = sampler.get2D();
+		double su = std::sqrt(uv.x);
+		double b1 = 1 - su;
+		double b2 = uv.y * su;
+
+		const uint32_t* idx = &indices[3 * tri];
+		Point P = (1 - b1 - b2) * positions[idx[0]] + b1 * positions[idx[1]] + b2 * positions[idx[2]];
+		Vec vec = P - origin;
+
+		assert(glm::length(vec) > 0);
+		return glm::normalize(vec);
+	}
+
+	double power(const MaterialTable& materials) const override
+	{
+		double total = 0;
+		for (int tri = 0; tri < triangleCount(); tri++)
+			total += triangleArea(tri) * pi * luminance(materials[materialOf(tri)].emission());
+		return total;
+	}
+
+	LightBounds lightBounds(const MaterialTable& materials) const override
+	{
+		// triangles may face anywhere, so bound the emission by every direction
+		return LightBounds(boundingBox(), Vec(0, 0, 1), power(materials), -1, 0);
+	}
+
+	int triangleCount() const { return (int)(indices.size() / 3); }
+	int vertexCount() const { return (int)positions.size(); }
+	double area() const { return totalArea; }
+
+private:
+	std::vector<Point> positions;
+	std::vector<Vec> normals; // empty, or one per position
+	std::vector<uint32_t> indices; // three per triangle, triangles in leaf order
+	std::vector<MaterialId> triangleMaterials; // empty, or one per triangle in leaf order
+	MaterialId mat;
+	std::vector<double> areaCdf; // running sum of triangle areas
+	double totalArea = 0;
+	Aabb meshBounds;
+	LinearBvh bvh;
+
+	/// <summary>
+	/// Per-ray part of the watertight test (Woop, Benthin and Wald 2013): a permutation and shear
+	/// that turn the ray into the +z axis through the origin, with z the direction's largest axis.
+	/// Kept as three rows so a vertex transforms with dot products instead of indexing by axis; the
+	/// zero entries add nothing, so the result is the same as the permuted formulation.
+	/// </summary>
+	struct RayTransform
+	{
+		Vec rowX, rowY, rowZ;
+
+		explicit RayTransform(const Ray& ray)
+		{
+			Vec d = ray.dir();
+			Vec absDir = glm::abs(d);
+
+			int kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2) : (absDir.y > absDir.z ? 1 : 2);
+			int kx = (kz + 1) % 3;
+			int ky = (kx + 1) % 3;
+
+			// keep the winding intact when the ray points down its z axis
+			if (d[kz] < 0)
+				std::swap(kx, ky);
+
+			rowX = Vec(0, 0, 0);
+			rowY = Vec(0, 0, 0);
+			rowZ = Vec(0, 0, 0);
+
+			// one reciprocal shared by all rows; any per-ray transform keeps the test watertight
+			// as long as every triangle sees the same one
+			double invZ = 1.0 / d[kz];
+			rowX[kx] = 1;
+			rowX[kz] = -d[kx] * invZ;
+			rowY[ky] = 1;
+			rowY[kz] = -d[ky] * invZ;
+			rowZ[kz] = invZ;
+		}
+	};
+
+	MaterialId materialOf(int tri) const
+	{
+		return triangleMaterials.empty() ? mat : triangleMaterials[tri];
+	}
+
+	double triangleArea(int tri) const
+	{
+		const uint32_t* idx = &indices[3 * tri];
+		return 0.5 * glm::length(glm::cross(positions[idx[1]] - positions[idx[0]], positions[idx[2]] - positions[idx[0]]));
+	}
+
+	/// <summary>
+	/// Watertight ray-triangle test: in ray space the edge functions are evaluated on the sheared
+	/// vertices, so rays through a shared edge or vertex hit exactly one of the triangles meeting
+	/// there, never none. Returns t and the barycentrics of p0, p1, p2.
+	/// </summary>
+	bool intersect(int tri, const Ray& ray, const RayTransform& rt, const Interval& interval,
+		double& t, double& b0, double& b1, double& b2) const
+	{
+		const uint32_t* idx = &indices[3 * tri];
+		Vec a = positions[idx[0]] - ray.origin();
+		Vec b = positions[idx[1]] - ray.origin();
+		Vec c = positions[idx[2]] - ray.origin();
+
+		double ax = glm::dot(rt.rowX, a);
+		double ay = glm::dot(rt.rowY, a);
+		double bx = glm::dot(rt.rowX, b);
+		double by = glm::dot(rt.rowY, b);
+		double cx = glm::dot(rt.rowX, c);
+		double cy = glm::dot(rt.rowY, c);
+
+		// edge functions, one per vertex opposite the edge
+		double u = cx * by - cy * bx;
+		double v = ax * cy - ay * cx;
+		double w = bx * ay - by * ax;
+
+		if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+			return false;
+
+		double det = u + v + w;
+		if (det == 0)
+			return false;
+
+		double az = glm::dot(rt.rowZ, a);
+		double bz = glm::dot(rt.rowZ, b);
+		double cz = glm::dot(rt.rowZ, c);
+
+		t = (u * az + v * bz + w * cz) / det;
+		if (!interval.surrounds(t))
+			return false;
+
+		b0 = u / det;
+		b1 = v / det;
+		b2 = w / det;
+		return true;
+	}
+};
@@ -0,0 +1,445 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "LinearBvh.h"
+#include "Simd.h"
+
+/// <summary>
+/// Node of a Width-ary BVH. Child bounds are stored as structure of arrays, one row of Width
+/// floats per plane, so one SIMD pass tests a ray against every child. A child is either another
+/// node (primCount 0) or a leaf range of primCount primitives starting at child. Unused slots have
+/// inverted bounds and never hit.
+/// </summary>
+template <int Width>
+struct alignas(32) WideBvhNode
+{
+	float bounds[6][Width]; // min x, y, z, then max x, y, z
+	uint32_t child[Width];
+	uint16_t primCount[Width];
+};
+
+// ray in the form the child tests want it, set up once per ray
+struct WideRay
+{
+	float origin[3];
+	float invDir[3];
+	int nearRow[3]; // bounds row of the plane the ray enters a slab through, per axis
+	int farRow[3];
+
+	explicit WideRay(const Ray& ray)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			origin[axis] = (float)ray.origin()[axis];
+			invDir[axis] = (float)(1.0 / ray.dir()[axis]);
+			bool negative = invDir[axis] < 0;
+			nearRow[axis] = negative ? axis + 3 : axis;
+			farRow[axis] = negative ? axis : axis + 3;
+		}
+	}
+};
+
+/// <summary>
+/// Slab tests of one ray against all children of a node. Each writes the entry distance of
+/// every child and returns a bit mask of the children hit within [tMin, tMax]. A NaN from a ray
+/// lying in a slab plane leaves the running interval alone, as it does in every variant.
+/// </summary>
+struct WideBvhKernels
+{
+	// far distances grow by this to absorb the rounding of float slab tests (pbrt's 1 + 2 gamma(3))
+	static constexpr float FarScale = 1 + 2 * (3 * 0.5f * std::numeric_limits<float>::epsilon());
+
+	template <int Width>
+	static int scalar(const WideBvhNode<Width>& node, const WideRay& ray, float tMin, float tMax, float* tNear)
+	{
+		int mask = 0;
+
+		for (int lane = 0; lane < Width; lane++)
+		{
+			float t0 = tMin;
+			float t1 = tMax;
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float tn = (node.bounds[ray.nearRow[axis]][lane] - ray.origin[axis]) * ray.invDir[axis];
+				float tf = (node.bounds[ray.farRow[axis]][lane] - ray.origin[axis]) * ray.invDir[axis] * FarScale;
+				t0 = tn > t0 ? tn : t0;
+				t1 = tf < t1 ? tf : t1;
+			}
+
+			tNear[lane] = t0;
+			if (t0 <= t1)
+				mask |= 1 << lane;
+		}
+		return mask;
+	}
+
+#ifdef RAYTRACING_X86
+	static int sse(const WideBvhNode<4>& node, const WideRay& ray, float tMin, float tMax, float* tNear)
+	{
+		__m128 t0 = _mm_set1_ps(tMin);
+		__m128 t1 = _mm_set1_ps(tMax);
+		__m128 farScale = _mm_set1_ps(FarScale);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 origin = _mm_set1_ps(ray.origin[axis]);
+			__m128 invDir = _mm_set1_ps(ray.invDir[axis]);
+			__m128 tn = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.nearRow[axis]]), origin), invDir);
+			__m128 tf = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.farRow[axis]]), origin), invDir), farScale);
+
+			// max / min return their second operand when either is NaN
+			t0 = _mm_max_ps(tn, t0);
+			t1 = _mm_min_ps(tf, t1);
+		}
+
+		_mm_storeu_ps(tNear, t0);
+		return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+	}
+
+	SIMD_AVX2 static int avx2(const WideBvhNode<8>& node, const WideRay& ray, float tMin, float tMax, float* tNear)
+	{
+		__m256 t0 = _mm256_set1_ps(tMin);
+		__m256 t1 = _mm256_set1_ps(tMax);
+		__m256 farScale = _mm256_set1_ps(FarScale);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+			__m256 invDir = _mm256_set1_ps(ray.invDir[axis]);
+			__m256 tn = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[ray.nearRow[axis]]), origin), invDir);
+			__m256 tf = _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.bounds[ray.farRow[axis]]), origin), invDir), farScale);
+
+			t0 = _mm256_max_ps(tn, t0);
+			t1 = _mm256_min_ps(tf, t1);
+		}
+
+		_mm256_storeu_ps(tNear, t0);
+		return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+	}
+#endif
+};
+
+/// <summary>
+/// Width-ary BVH (4 or 8) collapsed from a binary LinearBvh: every node pulls up the children of
+/// its largest interior children until it has Width of them. Leaves keep their ranges, so the
+/// same primitive order serves both. Traversal tests all children of a node in one pass with
+/// the widest kernel the CPU runs (AVX2 for 8 wide, SSE for 4 wide, scalar otherwise) and visits
+/// the children hit nearest first.
+///
+/// The tests run in float on bounds padded by a millionth of the scene size, so they only ever
+/// let extra boxes through, never drop one the binary double test would hit.
+/// </summary>
+template <int Width>
+class WideBvh
+{
+public:
+	static_assert(Width == 4 || Width == 8, "WideBvh is 4 or 8 wide");
+
+	// wide nodes are at most as deep as binary ones; each level leaves at most Width - 1 entries behind
+	static constexpr int StackSize = LinearBvh::StackSize * (Width - 1) + 1;
+
+	WideBvh() = default;
+
+	explicit WideBvh(const LinearBvh& binary, SimdLevel simd = detectSimd())
+	{
+		kernel = SimdLevel::Scalar;
+		if (Width == 4 && simd >= SimdLevel::Sse)
+			kernel = SimdLevel::Sse;
+		if (Width == 8 && simd >= SimdLevel::Avx2)
+			kernel = SimdLevel::Avx2;
+
+		if (binary.nodeCount() == 0)
+			return;
+
+		Aabb root = binary.bounds();
+		double scale = 0;
+		for (int axis = 0; axis < 3; axis++)
+			scale = std::max({ scale, std::fabs(root.min[axis]), std::fabs(root.max[axis]) });
+		padding = scale * 1e-6;
+
+		nodes.reserve(binary.nodeCount() / (Width - 1) + 1);
+		collapse(binary, 0);
+	}
+
+	/// <summary>
+	/// Closest-hit traversal with the same contract as LinearBvh::traverse.
+	/// </summary>
+	template <typename IntersectFn>
+	bool traverse(const Ray& ray, double tMin, double& closestHit, IntersectFn&& intersectPrim, long long& visits) const
+	{
+#ifdef RAYTRACING_X86
+		if constexpr (Width == 8)
+		{
+			if (kernel == SimdLevel::Avx2)
+				return traverseAvx2(ray, tMin, closestHit, intersectPrim, visits);
+		}
+		else
+		{
+			if (kernel == SimdLevel::Sse)
+				return closest(ray, tMin, closestHit, intersectPrim, visits, [](auto&... args) { return WideBvhKernels::sse(args...); });
+		}
+#endif
+		return closest(ray, tMin, closestHit, intersectPrim, visits, [](auto&... args) { return WideBvhKernels::scalar<Width>(args...); });
+	}
+
+	/// <summary>
+	/// Any-hit traversal with the same contract as LinearBvh::traverseAny.
+	/// </summary>
+	template <typename OccludedFn>
+	bool traverseAny(const Ray& ray, double tMin, double tMax, OccludedFn&& occludedPrim, long long& visits) const
+	{
+#ifdef RAYTRACING_X86
+		if constexpr (Width == 8)
+		{
+			if (kernel == SimdLevel::Avx2)
+				return traverseAnyAvx2(ray, tMin, tMax, occludedPrim, visits);
+		}
+		else
+		{
+			if (kernel == SimdLevel::Sse)
+				return any(ray, tMin, tMax, occludedPrim, visits, [](auto&... args) { return WideBvhKernels::sse(args...); });
+		}
+#endif
+		return any(ray, tMin, tMax, occludedPrim, visits, [](auto&... args) { return WideBvhKernels::scalar<Width>(args...); });
+	}
+
+	int nodeCount() const { return (int)nodes.size(); }
+	SimdLevel simdLevel() const { return kernel; }
+
+private:
+	std::vector<WideBvhNode<Width>> nodes;
+	SimdLevel kernel = SimdLevel::Scalar;
+	double padding = 0;
+
+	struct Entry
+	{
+		uint32_t child;
+		uint16_t primCount;
+		float tNear;
+	};
+
+	/// <summary>
+	/// Turns the binary subtree at index into a wide node and returns the node's index. Children
+	/// are opened largest surface area first, since those are the ones rays enter most.
+	/// </summary>
+	int collapse(const LinearBvh& binary, int index)
+	{
+		const BvhNode* binaryNodes = binary.nodeData();
+		int wideIndex = (int)nodes.size();
+		nodes.emplace_back();
+
+		std::vector<int> children;
+		if (binaryNodes[index].primCount > 0)
+		{
+			children.push_back(index); // a tree that is a single leaf
+		}
+		else
+		{
+			children.push_back(index + 1);
+			children.push_back(binaryNodes[index].offset);
+		}
+
+		while ((int)children.size() < Width)
+		{
+			int open = -1;
+			double openArea = -1;
+
+			for (int i = 0; i < (int)children.size(); i++)
+			{
+				double area = binary.nodeBounds(children[i]).surfaceArea();
+				if (binaryNodes[children[i]].primCount == 0 && area > openArea)
+				{
+					open = i;
+					openArea = area;
+				}
+			}
+
+			if (open < 0)
+				break;
+
+			int opened = children[open];
+			children[open] = opened + 1;
+			children.push_back(binaryNodes[opened].offset);
+		}
+
+		WideBvhNode<Width> node{};
+		for (int lane = 0; lane < Width; lane++)
+		{
+			if (lane >= (int)children.size())
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					node.bounds[axis][lane] = std::numeric_limits<float>::infinity();
+					node.bounds[axis + 3][lane] = -std::numeric_limits<float>::infinity();
+				}
+				continue;
+			}
+
+			const BvhNode& child = binaryNodes[children[lane]];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				node.bounds[axis][lane] = std::nextafter((float)(child.min[axis] - padding), -std::numeric_limits<float>::infinity());
+				node.bounds[axis + 3][lane] = std::nextafter((float)(child.max[axis] + padding), std::numeric_limits<float>::infinity());
+			}
+
+			if (child.primCount > 0)
+			{
+				node.child[lane] = child.offset;
+				node.primCount[lane] = child.primCount;
+			}
+		}
+
+		// children after the node is in place, the vector may move while they are added
+		for (int lane = 0; lane < (int)children.size(); lane++)
+		{
+			if (binaryNodes[children[lane]].primCount == 0)
+				node.child[lane] = (uint32_t)collapse(binary, children[lane]);
+		}
+
+		nodes[wideIndex] = node;
+		return wideIndex;
+	}
+
+	// hit children onto the stack farthest first, so the nearest is popped next
+	static void pushSorted(Entry* stack, int& stackSize, const WideBvhNode<Width>& node, int mask, const float* tNear)
+	{
+		int lanes[Width];
+		int count = 0;
+
+		for (int lane = 0; lane < Width; lane++)
+		{
+			if (!(mask & (1 << lane)))
+				continue;
+
+			int i = count++;
+			while (i > 0 && tNear[lanes[i - 1]] < tNear[lane])
+			{
+				lanes[i] = lanes[i - 1];
+				i--;
+			}
+			lanes[i] = lane;
+		}
+
+		for (int i = 0; i < count; i++)
+			stack[stackSize++] = { node.child[lanes[i]], node.primCount[lanes[i]], tNear[lanes[i]] };
+	}
+
+	// closest hits may sit exactly on a box, so round the cut-off up rather than down
+	static float upper(double t)
+	{
+		float f = (float)t;
+		return f < t ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+	}
+
+	static float lower(double t)
+	{
+		float f = (float)t;
+		return f > t ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+	}
+
+	template <typename IntersectFn, typename Kernel>
+	bool closest(const Ray& ray, double tMin, double& closestHit, IntersectFn& intersectPrim, long long& visits, Kernel&& test) const
+	{
+		if (nodes.empty())
+			return false;
+
+		WideRay wideRay(ray);
+		float tMinF = lower(tMin);
+
+		Entry stack[StackSize];
+		int stackSize = 0;
+		stack[stackSize++] = { 0, 0, tMinF };
+		bool hitValid = false;
+
+		while (stackSize > 0)
+		{
+			Entry entry = stack[--stackSize];
+
+			// something nearer turned up since this child was pushed
+			if (entry.tNear > closestHit)
+				continue;
+
+			if (entry.primCount > 0)
+			{
+				for (uint32_t i = entry.child; i < entry.child + entry.primCount; i++)
+				{
+					if (intersectPrim(i, tMin, closestHit))
+						hitValid = true;
+				}
+				continue;
+			}
+
+			const WideBvhNode<Width>& node = nodes[entry.child];
+			visits++;
+
+			alignas(32) float tNear[Width];
+			float tMaxF = upper(closestHit);
+			int mask = test(node, wideRay, tMinF, tMaxF, tNear);
+			pushSorted(stack, stackSize, node, mask, tNear);
+		}
+		return hitValid;
+	}
+
+	template <typename OccludedFn, typename Kernel>
+	bool any(const Ray& ray, double tMin, double tMax, OccludedFn& occludedPrim, long long& visits, Kernel&& test) const
+	{
+		if (nodes.empty())
+			return false;
+
+		WideRay wideRay(ray);
+		float tMinF = lower(tMin);
+		float tMaxF = upper(tMax);
+
+		Entry stack[StackSize];
+		int stackSize = 0;
+		stack[stackSize++] = { 0, 0, tMinF };
+
+		while (stackSize > 0)
+		{
+			Entry entry = stack[--stackSize];
+
+			if (entry.primCount > 0)
+			{
+				for (uint32_t i = entry.child; i < entry.child + entry.primCount; i++)
+				{
+					if (occludedPrim(i))
+						return true;
+				}
+				continue;
+			}
+
+			const WideBvhNode<Width>& node = nodes[entry.child];
+			visits++;
+
+			alignas(32) float tNear[Width];
+			int mask = test(node, wideRay, tMinF, tMaxF, tNear);
+			pushSorted(stack, stackSize, node, mask, tNear);
+		}
+		return false;
+	}
+
+#ifdef RAYTRACING_X86
+	template <typename IntersectFn>
+	SIMD_AVX2_ENTRY bool traverseAvx2(const Ray& ray, double tMin, double& closestHit, IntersectFn& intersectPrim, long long& visits) const
+	{
+		if constexpr (Width == 8)
+			return closest(ray, tMin, closestHit, intersectPrim, visits, [](auto&... args) { return WideBvhKernels::avx2(args...); });
+		else
+			return false;
+	}
+
+	template <typename OccludedFn>
+	SIMD_AVX2_ENTRY bool traverseAnyAvx2(const Ray& ray, double tMin, double tMax, OccludedFn& occludedPrim, long long& visits) const
+	{
+		if constexpr (Width == 8)
+			return any(ray, tMin, tMax, occludedPrim, visits, [](auto&... args) { return WideBvhKernels::avx2(args...); });
+		else
+			return false;
+	}
+#endif
+};
@@ -0,0 +1,101 @@
+#pragma once
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Runs work(0) .. work(count - 1), each in its own forked process, and returns what each returned
+/// in index order, whatever order they finish in. Results come back over one pipe per worker.
+/// Without fork (Windows) the same calls run one after another in this process, so callers get
+/// identical results either way. Throws if a worker fails.
+/// </summary>
+template <typename Fn>
+std::vector<std::string> runWorkerProcesses(int count, Fn work)
+{
+	std::vector<std::string> results(count);
+
+#ifdef _WIN32
+	for (int k = 0; k < count; k++)
+		results[k] = work(k);
+#else
+	std::vector<pid_t> pids;
+	std::vector<int> readEnds;
+
+	for (int k = 0; k < count; k++)
+	{
+		int fds[2];
+		if (pipe(fds) != 0)
+			throw std::runtime_error("Cannot create pipe for worker process");
+
+		pid_t pid = fork();
+		if (pid < 0)
+			throw std::runtime_error("Cannot fork worker process");
+
+		if (pid == 0)
+		{
+			close(fds[0]);
+			for (int fd : readEnds)
+				close(fd);
+
+			// _exit: the child must not run the parent's destructors or flush its buffers
+			int status = 0;
+			try
+			{
+				std::string result = work(k);
+
+				for (size_t written = 0; written < result.size(); )
+				{
+					ssize_t n = write(fds[1], result.data() + written, result.size() - written);
+					if (n < 0 && errno == EINTR)
+						continue;
+					if (n <= 0)
+						_exit(1);
+					written += n;
+				}
+			}
+			catch (...)
+			{
+				status = 1;
+			}
+			close(fds[1]);
+			_exit(status);
+		}
+
+		close(fds[1]);
+		pids.push_back(pid);
+		readEnds.push_back(fds[0]);
+	}
+
+	// workers block on a full pipe until read, reading them in order can't deadlock
+	for (int k = 0; k < count; k++)
+	{
+		char buffer[1 << 16];
+		while (true)
+		{
+			ssize_t n = read(readEnds[k], buffer, sizeof(buffer));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				break;
+			results[k].append(buffer, n);
+		}
+		close(readEnds[k]);
+	}
+
+	for (int k = 0; k < count; k++)
+	{
+		int status = 0;
+		if (waitpid(pids[k], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			throw std::runtime_error("Worker process " + std::to_string(k) + " failed");
+	}
+#endif
+
+	return results;
+}
@@ -0,0 +1,133 @@
+// Path tracing a sample must not touch the heap: scatter pdfs live on the stack and hits point at
+// materials instead of sharing them. Counts global operator new calls while rayColor runs over the
+// given scenes with every light sampler and fails if there is a single one.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "Camera.h"
+#include "Scene.h"
+#include "SceneCache.h"
+
+static std::atomic<long long> allocations{ 0 };
+static std::atomic<bool> counting{ false };
+
+static void count()
+{
+	if (counting.load(std::memory_order_relaxed))
+		allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void* allocate(std::size_t size)
+{
+	count();
+	void* p = std::malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+// over-aligned types come through here; MSVC has no std::aligned_alloc
+static void* allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+	count();
+	std::size_t align = (std::size_t)alignment;
+	size = (size + align - 1) / align * align;
+#ifdef _MSC_VER
+	void* p = _aligned_malloc(size ? size : align, align);
+#else
+	void* p = std::aligned_alloc(align, size ? size : align);
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void freeAligned(void* p)
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { freeAligned(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { freeAligned(p); }
+
+static constexpr int SampleCount = 4096;
+
+// heap allocations made by SampleCount camera samples spread over the image
+static long long countAllocations(const Scene& scene, const Camera& cam, const LightSampler& lights)
+{
+	Sampler sampler(scene.camera.sampler, SampleCount, scene.seed);
+	int pixels = cam.imageWidth() * cam.imageHeight();
+	double sum = 0;
+
+	allocations = 0;
+	counting = true;
+
+	for (int i = 0; i < SampleCount; i++)
+	{
+		int pixel = (int)((long long)i * 7919 % pixels);
+		int row = pixel / cam.imageWidth();
+		int col = pixel % cam.imageWidth();
+
+		sampler.startPixelSample(pixel, i);
+		Ray ray = cam.sampleRayToPixel(row, col, sampler);
+		Color color = cam.rayColor(ray, *scene.bvh, lights, scene.materials, scene.camera.maxDepth, sampler);
+		sum += color.x + color.y + color.z;
+	}
+
+	counting = false;
+
+	// keep the work observable
+	if (sum < 0)
+		std::printf("negative radiance\n");
+	return allocations.load();
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::printf("Usage: AllocTest scene...\n");
+		return 2;
+	}
+
+	int failures = 0;
+
+	for (int arg = 1; arg < argc; arg++)
+	{
+		Scene scene = loadScene(argv[arg], false);
+		Camera cam(scene.camera, Random(scene.seed));
+
+		const LightSamplerType types[] = { LightSamplerType::Uniform, LightSamplerType::Power, LightSamplerType::Bvh };
+		const char* names[] = { "uniform", "power", "bvh" };
+
+		for (int i = 0; i < 3; i++)
+		{
+			scene.lightSampler = types[i];
+			auto lights = makeLightSampler(scene);
+
+			long long count = countAllocations(scene, cam, *lights);
+			std::printf("%s, %s light sampler: %lld allocations in %d samples\n", argv[arg], names[i], count, SampleCount);
+			if (count != 0)
+				failures++;
+		}
+	}
+
+	return failures == 0 ? 0 : 1;
+}